@@ -167,7 +167,7 @@ initialized (gpointer user_data)
 static void
 android_launch_init (JNIEnv * env, jobject thiz)
 {
-  GstLaunchRemoteAppContext app_context;
+  GstLaunchRemoteAppContext app_context = { 0, };
   AndroidLaunch *app = g_slice_new0 (AndroidLaunch);
 
   GST_DEBUG_CATEGORY_INIT (debug_category, "android-launch", 0,
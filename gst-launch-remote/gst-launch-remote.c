@@ -18,17 +18,51 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include "gst-launch-remote.h"
 
 #include <string.h>
 #include <stdlib.h>
-#include <gst/net/net.h>
+#include <errno.h>
+
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#endif
 
 GST_DEBUG_CATEGORY_STATIC (debug_category);
 #define GST_CAT_DEFAULT debug_category
 
 static void gst_launch_remote_set_pipeline (GstLaunchRemote * self,
     const gchar * pipeline_string);
+static void write_to_remote (GstLaunchRemote * self, const gchar * format,
+    ...);
+static gboolean handle_command (GstLaunchRemote * self, gchar * line);
+static void play_pipeline (GstLaunchRemote * self);
+static void pause_pipeline (GstLaunchRemote * self);
+
+/* Give up on a benchmark seek if it did not complete after this long */
+#define SEEK_BENCH_TIMEOUT_MS 5000
+/* Default time a script waits for an event before it is aborted */
+#define SCRIPT_WAIT_TIMEOUT_MS 10000
+/* Application callbacks are delivered at most at this rate by default */
+#define CALLBACK_DEFAULT_FPS 60
+/* A +REPLACE swaps without draining if the old element took longer than this */
+#define REPLACE_DRAIN_TIMEOUT_MS 5000
+/* Limits for requests to the HTTP metrics endpoint */
+#define METRICS_MAX_LINE_LENGTH 4096
+#define METRICS_MAX_HEADERS 64
 
 G_LOCK_DEFINE_STATIC (debug_sockets);
 typedef struct
@@ -37,16 +71,160 @@ typedef struct
   GSocketAddress *address;
 } DebugSocket;
 static GList *debug_sockets = NULL;
+static gint debug_records_sent = 0;
+static gint debug_records_dropped = 0;
+
+/* On-device circular log file. The file starts with a DebugFileHeader
+ * followed by the data area, which contains the same text records as the
+ * UDP stream. write_pos counts all bytes ever written: if it is larger
+ * than the data area the log wrapped around and the oldest data starts at
+ * write_pos % size, beginning with a partial record. tools/decode-debug-file.py
+ * turns it back into text */
+#define DEBUG_FILE_MAGIC "GSTLRLOG"
+#define DEBUG_FILE_VERSION 1
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 header_size;
+  guint64 size;
+  guint64 write_pos;
+} DebugFileHeader;
+
+G_LOCK_DEFINE_STATIC (debug_file);
+static DebugFileHeader *debug_file = NULL;
+static gsize debug_file_mapped = 0;
+static gchar *debug_file_path = NULL;
+/* Writers that reserved space and are still copying */
+static gint debug_file_writers = 0;
+
+/* Called without the lock on space reserved at pos. Only copies into the
+ * mapping, the kernel writes back the pages */
+static void
+debug_file_write (DebugFileHeader * header, guint64 * pos,
+    const gchar * data, gsize len)
+{
+  guint8 *area = (guint8 *) header + sizeof (DebugFileHeader);
+  guint64 size = header->size;
+
+  while (len > 0) {
+    gsize offset = *pos % size;
+    gsize chunk = MIN (len, size - offset);
+
+    memcpy (area + offset, data, chunk);
+    *pos += chunk;
+    data += chunk;
+    len -= chunk;
+  }
+}
+
+static void
+debug_file_close (void)
+{
+  DebugFileHeader *header;
+  gsize mapped;
+
+  G_LOCK (debug_file);
+  header = debug_file;
+  mapped = debug_file_mapped;
+  debug_file = NULL;
+  debug_file_mapped = 0;
+  g_free (debug_file_path);
+  debug_file_path = NULL;
+  G_UNLOCK (debug_file);
+
+  /* No new writers can get the old mapping now */
+  while (g_atomic_int_get (&debug_file_writers) > 0)
+    g_thread_yield ();
+
+#ifdef G_OS_UNIX
+  if (header) {
+    msync (header, mapped, MS_SYNC);
+    munmap (header, mapped);
+  }
+#endif
+}
+
+static gboolean
+debug_file_open (const gchar * path, guint64 size, gchar ** error)
+{
+#ifdef G_OS_UNIX
+  DebugFileHeader *header;
+  gsize mapped = sizeof (DebugFileHeader) + size;
+  gint fd;
+
+  fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    *error = g_strdup_printf ("Can't open %s: %s", path, g_strerror (errno));
+    return FALSE;
+  }
+
+  /* Allocate all blocks now instead of on the first write to each page */
+#ifdef __linux__
+  if (posix_fallocate (fd, 0, mapped) != 0 && ftruncate (fd, mapped) != 0) {
+#else
+  if (ftruncate (fd, mapped) != 0) {
+#endif
+    *error = g_strdup_printf ("Can't resize %s: %s", path, g_strerror (errno));
+    close (fd);
+    return FALSE;
+  }
+
+  header = mmap (NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (header == MAP_FAILED) {
+    *error = g_strdup_printf ("Can't map %s: %s", path, g_strerror (errno));
+    return FALSE;
+  }
+
+  memcpy (header->magic, DEBUG_FILE_MAGIC, sizeof (header->magic));
+  header->version = DEBUG_FILE_VERSION;
+  header->header_size = sizeof (DebugFileHeader);
+  header->size = size;
+  header->write_pos = 0;
+
+  debug_file_close ();
+  G_LOCK (debug_file);
+  debug_file = header;
+  debug_file_mapped = mapped;
+  debug_file_path = g_strdup (path);
+  G_UNLOCK (debug_file);
+
+  return TRUE;
+#else
+  *error = g_strdup ("Debug files not supported on this platform");
+  return FALSE;
+#endif
+}
+
+static gboolean
+debug_file_active (void)
+{
+  gboolean active;
+
+  G_LOCK (debug_file);
+  active = debug_file != NULL;
+  G_UNLOCK (debug_file);
+
+  return active;
+}
 
 static void
 send_debug (const gchar * prefix, const gchar * message)
 {
   GList *l;
   GOutputVector data[5];
+  gchar count_str[16];
   static guint count = 0;
-
-  data[0].buffer = g_strdup_printf ("0x%010u ", count++);
-  data[0].size = strlen (data[0].buffer);
+  DebugFileHeader *header = NULL;
+  guint64 pos = 0;
+  gsize total = 0;
+  guint i;
+
+  g_snprintf (count_str, sizeof (count_str), "0x%010u ", count++);
+  data[0].buffer = count_str;
+  data[0].size = strlen (count_str);
   data[1].buffer = prefix;
   data[1].size = strlen (prefix);
   data[2].buffer = ": ";
@@ -63,10 +241,32 @@ send_debug (const gchar * prefix, const gchar * message)
     if (!s->address)
       continue;
 
-    g_socket_send_message (s->socket, s->address, data, G_N_ELEMENTS (data),
-        NULL, 0, G_SOCKET_MSG_NONE, NULL, NULL);
+    if (g_socket_send_message (s->socket, s->address, data,
+            G_N_ELEMENTS (data), NULL, 0, G_SOCKET_MSG_NONE, NULL, NULL) < 0)
+      g_atomic_int_inc (&debug_records_dropped);
+    else
+      g_atomic_int_inc (&debug_records_sent);
   }
   G_UNLOCK (debug_sockets);
+
+  /* Only reserve the space with the lock, copy without it */
+  for (i = 0; i < G_N_ELEMENTS (data); i++)
+    total += data[i].size;
+
+  G_LOCK (debug_file);
+  if (debug_file) {
+    header = debug_file;
+    pos = header->write_pos;
+    header->write_pos += total;
+    g_atomic_int_inc (&debug_file_writers);
+  }
+  G_UNLOCK (debug_file);
+
+  if (header) {
+    for (i = 0; i < G_N_ELEMENTS (data); i++)
+      debug_file_write (header, &pos, data[i].buffer, data[i].size);
+    g_atomic_int_add (&debug_file_writers, -1);
+  }
 }
 
 void
@@ -278,282 +478,5950 @@ priv_gst_debug_logcat (GstDebugCategory * category, GstDebugLevel level,
   g_free (m);
 }
 
-static void
-send_pipeline_dump (GstLaunchRemote * self, const gchar * dest, gint port)
-{
-  GError *err = NULL;
-  GSocketConnection *connection = NULL;
-  GSocketClient *client = g_socket_client_new ();
-  GOutputStream *ostream;
+static GQuark pad_counter_quark;
+static GQuark stall_probe_quark;
 
-  gchar *dump_str;
+/* Protects the 64 bit byte counts, which can't be read atomically on all
+ * platforms */
+G_LOCK_DEFINE_STATIC (pad_counters);
 
-  connection = g_socket_client_connect_to_host (client, dest, port, NULL, &err);
-  if (!connection) {
-    GST_ERROR ("ERROR: Can't connect to remote: %s", err->message);
-    g_clear_error (&err);
-    return;
-  }
+typedef struct
+{
+  gint buffers;
+  guint64 bytes;
+  gulong probe_id;
+} PadCounter;
 
-  ostream = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+static void
+pad_counter_free (PadCounter * counter)
+{
+  g_slice_free (PadCounter, counter);
+}
 
-  dump_str =
-      gst_debug_bin_to_dot_data (GST_BIN (self->pipeline),
-      GST_DEBUG_GRAPH_SHOW_ALL);
-  if (dump_str == NULL) {
-    GST_ERROR ("ERROR: failed to collect dump data: %s", err->message);
-    goto done;
-  }
+/* Called from the streaming thread */
+static GstPadProbeReturn
+pad_counter_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    PadCounter * counter)
+{
+  gsize size;
 
-  if (!g_output_stream_write_all (ostream, dump_str, strlen (dump_str), NULL,
-          NULL, &err)) {
-    GST_ERROR ("ERROR: failed to send data: %s", err->message);
-    g_clear_error (&err);
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+
+    g_atomic_int_add (&counter->buffers, gst_buffer_list_length (list));
+    size = gst_buffer_list_calculate_size (list);
+  } else {
+    g_atomic_int_inc (&counter->buffers);
+    size = gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
   }
 
-  g_free (dump_str);
+  G_LOCK (pad_counters);
+  counter->bytes += size;
+  G_UNLOCK (pad_counters);
 
-done:
-  g_object_unref (connection);
-  g_object_unref (client);
+  return GST_PAD_PROBE_OK;
 }
 
 static void
-set_message (GstLaunchRemote * self, const gchar * format, ...)
+pad_counter_install (const GValue * item, gpointer user_data)
 {
-  gchar *message;
-  va_list args;
+  GstPad *pad = g_value_get_object (item);
+  PadCounter *counter;
 
-  va_start (args, format);
-  message = g_strdup_vprintf (format, args);
-  va_end (args);
-
-  if (self->app_context.set_message) {
-    self->app_context.set_message (message, self->app_context.app);
-  }
+  if (g_object_get_qdata (G_OBJECT (pad), pad_counter_quark))
+    return;
 
-  g_free (self->last_message);
-  self->last_message = message;
+  /* The probe owns the counter, so it is only freed once a running probe
+   * callback returned */
+  counter = g_slice_new0 (PadCounter);
+  g_object_set_qdata (G_OBJECT (pad), pad_counter_quark, counter);
+  counter->probe_id = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) pad_counter_probe_cb, counter,
+      (GDestroyNotify) pad_counter_free);
 }
 
-static gboolean
-update_position_cb (GstLaunchRemote * self)
+static void
+pad_counter_remove (const GValue * item, gpointer user_data)
 {
-  gint64 duration = 0, position = 0;
-
-  if (!self || !self->app_context.set_current_position)
-    return TRUE;
-
-  if (self->pipeline) {
-    if (!gst_element_query_duration (self->pipeline, GST_FORMAT_TIME,
-            &duration)) {
-      GST_WARNING ("Could not query current duration");
-    }
-
-    if (!gst_element_query_position (self->pipeline, GST_FORMAT_TIME,
-            &position)) {
-      GST_WARNING ("Could not query current position");
-    }
+  GstPad *pad = g_value_get_object (item);
+  PadCounter *counter;
 
-    position = MAX (position, 0);
-    duration = MAX (duration, 0);
-  }
+  counter = g_object_steal_qdata (G_OBJECT (pad), pad_counter_quark);
+  if (counter)
+    gst_pad_remove_probe (pad, counter->probe_id);
+}
 
-  self->app_context.set_current_position (position / GST_MSECOND,
-      duration / GST_MSECOND, self->app_context.app);
+static void
+pad_counters_foreach_element (const GValue * item, gpointer user_data)
+{
+  GstElement *element = g_value_get_object (item);
+  GstIterator *it = gst_element_iterate_pads (element);
 
-  return TRUE;
+  while (gst_iterator_foreach (it, (GstIteratorForeachFunction) user_data,
+          NULL) == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
 }
 
 static void
-error_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+pad_counters_foreach (GstElement * pipeline, GstIteratorForeachFunction func)
 {
-  GError *err;
-  gchar *debug_info;
+  GstIterator *it = gst_bin_iterate_recurse (GST_BIN (pipeline));
 
-  gst_message_parse_error (msg, &err, &debug_info);
-  set_message (self, "Error received from element %s: %s",
-      GST_OBJECT_NAME (msg->src), err->message);
-  g_clear_error (&err);
-  g_free (debug_info);
+  while (gst_iterator_foreach (it, pad_counters_foreach_element,
+          func) == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+}
 
-  self->target_state = GST_STATE_NULL;
-  gst_element_set_state (self->pipeline, GST_STATE_NULL);
-  self->last_eos_time = gst_util_get_timestamp ();
-  gst_object_unref (self->pipeline);
-  if (self->video_sink)
-    gst_object_unref (self->video_sink);
-  self->pipeline = NULL;
-  self->video_sink = NULL;
+/* Counts buffers and bytes on every pad that exists at this point. The
+ * counters live as long as the pads or until they are removed. They are
+ * opt-in, as they add work for every buffer */
+static void
+pad_counters_install (GstElement * pipeline)
+{
+  pad_counters_foreach (pipeline, pad_counter_install);
 }
 
 static void
-eos_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+pad_counters_remove (GstElement * pipeline)
 {
-  self->target_state = GST_STATE_NULL;
-  gst_element_set_state (self->pipeline, GST_STATE_NULL);
-  self->last_eos_time = gst_util_get_timestamp ();
-  gst_object_unref (self->pipeline);
-  if (self->video_sink)
-    gst_object_unref (self->video_sink);
-  self->pipeline = NULL;
-  self->video_sink = NULL;
+  pad_counters_foreach (pipeline, pad_counter_remove);
 }
 
+typedef struct
+{
+  gint buffers_in, buffers_out;
+  guint64 bytes_in, bytes_out;
+  gboolean counted;
+} ElementCounts;
+
 static void
-buffering_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+element_counts_add_pad (const GValue * item, gpointer user_data)
 {
-  gint percent;
+  GstPad *pad = g_value_get_object (item);
+  ElementCounts *counts = user_data;
+  PadCounter *counter;
+  guint64 bytes;
 
-  if (self->is_live)
+  counter = g_object_get_qdata (G_OBJECT (pad), pad_counter_quark);
+  if (!counter)
     return;
 
-  gst_message_parse_buffering (msg, &percent);
-  if (percent < 100 && self->target_state >= GST_STATE_PAUSED) {
-    gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
-    set_message (self, "Buffering %d%%", percent);
-  } else if (self->target_state >= GST_STATE_PLAYING) {
-    gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
-  } else if (self->target_state >= GST_STATE_PAUSED) {
-    set_message (self, "Buffering complete");
+  G_LOCK (pad_counters);
+  bytes = counter->bytes;
+  G_UNLOCK (pad_counters);
+
+  counts->counted = TRUE;
+  if (GST_PAD_IS_SINK (pad)) {
+    counts->buffers_in += g_atomic_int_get (&counter->buffers);
+    counts->bytes_in += bytes;
+  } else {
+    counts->buffers_out += g_atomic_int_get (&counter->buffers);
+    counts->bytes_out += bytes;
   }
 }
 
-static void
-clock_lost_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+/* Short human readable statistics of an element: buffer counts and queue
+ * fill levels. Lines are separated by the given separator */
+static gchar *
+get_element_stats (GstElement * element, const gchar * separator)
 {
-  if (self->target_state >= GST_STATE_PLAYING) {
-    gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
-    gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
+  GString *s = g_string_new (NULL);
+  ElementCounts counts = { 0, };
+  GstIterator *it;
+
+  it = gst_element_iterate_pads (element);
+  while (gst_iterator_foreach (it, element_counts_add_pad,
+          &counts) == GST_ITERATOR_RESYNC) {
+    memset (&counts, 0, sizeof (counts));
+    gst_iterator_resync (it);
+  }
+  gst_iterator_free (it);
+
+  if (counts.counted)
+    g_string_append_printf (s, "in: %d buffers, %" G_GUINT64_FORMAT
+        " bytes%sout: %d buffers, %" G_GUINT64_FORMAT " bytes",
+        counts.buffers_in, counts.bytes_in, separator, counts.buffers_out,
+        counts.bytes_out);
+
+  /* queue and queue2 */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+          "current-level-buffers")) {
+    guint buffers = 0, max_buffers = 0, bytes = 0, max_bytes = 0;
+    guint64 time = 0, max_time = 0;
+
+    g_object_get (element, "current-level-buffers", &buffers,
+        "current-level-bytes", &bytes, "current-level-time", &time,
+        "max-size-buffers", &max_buffers, "max-size-bytes", &max_bytes,
+        "max-size-time", &max_time, NULL);
+    if (s->len > 0)
+      g_string_append (s, separator);
+    g_string_append_printf (s, "level: %u/%u buffers, %u/%u bytes, %"
+        GST_TIME_FORMAT "/%" GST_TIME_FORMAT, buffers, max_buffers, bytes,
+        max_bytes, GST_TIME_ARGS (time), GST_TIME_ARGS (max_time));
   }
+
+  if (s->len == 0) {
+    g_string_free (s, TRUE);
+    return NULL;
+  }
+
+  return g_string_free (s, FALSE);
+}
+
+/* Same naming as gst_debug_bin_to_dot_data() uses for its clusters */
+static gchar *
+make_dot_object_name (GstObject * object)
+{
+  return g_strcanon (g_strdup_printf ("%s_%p", GST_OBJECT_NAME (object),
+          object), G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS "_", '_');
 }
 
 static void
-check_media_size (GstLaunchRemote * self)
+annotate_element (const GValue * item, gpointer user_data)
 {
-  GstPad *video_sink_pad;
-  GstCaps *caps;
-  GstVideoInfo info;
+  GstElement *element = g_value_get_object (item);
+  GString *dot = user_data;
+  gchar *stats, *name;
 
-  if (!self->video_sink || !self->app_context.media_size_changed)
+  stats = get_element_stats (element, "\\l");
+  if (!stats)
     return;
 
-  /* Retrieve the Caps at the entrance of the video sink */
-  video_sink_pad = gst_element_get_static_pad (self->video_sink, "sink");
-  if (!video_sink_pad)
-    return;
+  /* Adds a note node to the element's existing cluster */
+  name = make_dot_object_name (GST_OBJECT (element));
+  g_string_append_printf (dot, "  subgraph cluster_%s {\n"
+      "    stats_%s [shape=note, style=filled, fillcolor=\"#ffffcc\", "
+      "label=\"%s\\l\"];\n  }\n", name, name, stats);
+  g_free (name);
+  g_free (stats);
+}
 
-  caps = gst_pad_get_current_caps (video_sink_pad);
+static gchar *
+get_annotated_dot_data (GstElement * pipeline)
+{
+  gchar *dot_data, *end;
+  GString *dot;
+  GstIterator *it;
 
-  if (gst_video_info_from_caps (&info, caps)) {
-    info.width = info.width * info.par_n / info.par_d;
-    GST_DEBUG ("Media size is %dx%d, notifying application", info.width,
-        info.height);
+  dot_data = gst_debug_bin_to_dot_data (GST_BIN (pipeline),
+      GST_DEBUG_GRAPH_SHOW_ALL);
+  if (!dot_data)
+    return NULL;
 
-    self->app_context.media_size_changed (info.width, info.height,
-        self->app_context.app);
-  }
+  /* Strip the closing brace of the graph and add the statistics before it */
+  end = strrchr (dot_data, '}');
+  if (!end)
+    return dot_data;
+  *end = '\0';
 
-  gst_caps_unref (caps);
-  gst_object_unref (video_sink_pad);
+  dot = g_string_new (dot_data);
+  g_free (dot_data);
+
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+  gst_iterator_foreach (it, annotate_element, dot);
+  gst_iterator_free (it);
+
+  g_string_append (dot, "}\n");
+
+  return g_string_free (dot, FALSE);
 }
 
+typedef struct
+{
+  GSocketClient *client;
+  GSocketConnection *connection;
+  GOutputStream *ostream;
+  GBytes *data;
+  gboolean compress;
+} SendJob;
+
 static void
-notify_caps_cb (GObject * object, GParamSpec * pspec, GstLaunchRemote * self)
+send_job_free (SendJob * job)
 {
-  check_media_size (self);
+  if (job->ostream)
+    g_object_unref (job->ostream);
+  if (job->connection)
+    g_object_unref (job->connection);
+  g_object_unref (job->client);
+  g_bytes_unref (job->data);
+  g_slice_free (SendJob, job);
 }
 
 static void
-sync_message_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+send_close_cb (GObject * source_object, GAsyncResult * res,
+    gpointer user_data)
 {
-  if (gst_is_video_overlay_prepare_window_handle_message (msg)) {
-    GstElement *element = GST_ELEMENT (GST_MESSAGE_SRC (msg));
-    GstPad *sinkpad;
-
-    /* Store video sink for later usage and set window on it if we have one */
-    gst_object_replace ((GstObject **) & self->video_sink,
-        (GstObject *) element);
-
-    sinkpad = gst_element_get_static_pad (element, "sink");
-    if (!sinkpad) {
-      sinkpad = gst_element_get_static_pad (element, "video_sink");
-    }
-
-    if (sinkpad) {
-      g_signal_connect (sinkpad, "notify::caps", (GCallback) notify_caps_cb,
-          self);
-      gst_object_unref (sinkpad);
-    }
+  SendJob *job = user_data;
+  GError *err = NULL;
 
-    gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (element),
-        (guintptr) self->window_handle);
+  if (!g_output_stream_close_finish (job->ostream, res, &err)) {
+    GST_ERROR ("ERROR: failed to close connection: %s", err->message);
+    g_clear_error (&err);
   }
+
+  send_job_free (job);
 }
 
-/* Notify UI about pipeline state changes */
 static void
-state_changed_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+send_write_cb (GObject * source_object, GAsyncResult * res,
+    gpointer user_data)
 {
-  GstState old_state, new_state, pending_state;
-
-  gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
-  /* Only pay attention to messages coming from the pipeline, not its children */
-  if (GST_MESSAGE_SRC (msg) == GST_OBJECT (self->pipeline)) {
-    set_message (self, "State changed to %s",
-        gst_element_state_get_name (new_state));
+  SendJob *job = user_data;
+  GError *err = NULL;
 
-    /* The Ready to Paused state change is particularly interesting: */
-    if (old_state == GST_STATE_READY && new_state == GST_STATE_PAUSED) {
-      /* By now the sink already knows the media size */
-      check_media_size (self);
-    }
+  if (!g_output_stream_write_all_finish (job->ostream, res, NULL, &err)) {
+    GST_ERROR ("ERROR: failed to send data: %s", err->message);
+    g_clear_error (&err);
   }
+
+  /* Also flushes the end of the compressed stream */
+  g_output_stream_close_async (job->ostream, G_PRIORITY_DEFAULT, NULL,
+      send_close_cb, job);
 }
 
-/* Check if all conditions are met to report GStreamer as initialized.
- * These conditions will change depending on the application */
 static void
-check_initialization_complete (GstLaunchRemote * self)
+send_connect_cb (GObject * source_object, GAsyncResult * res,
+    gpointer user_data)
 {
-  if (!self->initialized && self->window_handle && self->main_loop) {
-    GST_DEBUG
-        ("Initialization complete, notifying application. window handle: %p",
-        (gpointer) self->window_handle);
+  SendJob *job = user_data;
+  GOutputStream *ostream;
+  GError *err = NULL;
 
-    if (self->app_context.initialized)
-      self->app_context.initialized (self->app_context.app);
-    self->initialized = TRUE;
+  job->connection =
+      g_socket_client_connect_to_host_finish (job->client, res, &err);
+  if (!job->connection) {
+    GST_ERROR ("ERROR: Can't connect to remote: %s", err->message);
+    g_clear_error (&err);
+    send_job_free (job);
+    return;
+  }
+
+  ostream = g_io_stream_get_output_stream (G_IO_STREAM (job->connection));
+  if (job->compress) {
+    GZlibCompressor *compressor =
+        g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+
+    job->ostream = g_converter_output_stream_new (ostream,
+        G_CONVERTER (compressor));
+    g_object_unref (compressor);
+  } else {
+    job->ostream = g_object_ref (ostream);
   }
+
+  g_output_stream_write_all_async (job->ostream,
+      g_bytes_get_data (job->data, NULL), g_bytes_get_size (job->data),
+      G_PRIORITY_DEFAULT, NULL, send_write_cb, job);
 }
 
+/* Connects and sends without ever blocking the main loop */
 static void
-handle_eof (GstLaunchRemote * self)
+send_data_async (const gchar * dest, gint port, GBytes * data,
+    gboolean compress)
 {
-  g_object_unref (self->distream);
-  g_object_unref (self->connection);
-  self->connection = NULL;
+  SendJob *job = g_slice_new0 (SendJob);
+
+  job->client = g_socket_client_new ();
+  job->data = g_bytes_ref (data);
+  job->compress = compress;
+
+  g_socket_client_connect_to_host_async (job->client, dest, port, NULL,
+      send_connect_cb, job);
 }
 
-static void
-write_to_remote (GstLaunchRemote * self, const gchar * format, ...)
+static gboolean
+send_pipeline_dump (GstLaunchRemote * self, const gchar * dest, gint port,
+    gboolean compress)
 {
-  gchar *tmp;
-  va_list varargs;
+  gchar *dump_str;
+  GBytes *data;
 
-  if (self->connection == NULL)
-    return;
+  if (!self->pipeline)
+    return FALSE;
+
+  dump_str = get_annotated_dot_data (self->pipeline);
+  if (dump_str == NULL) {
+    GST_ERROR ("ERROR: failed to collect dump data");
+    return FALSE;
+  }
+
+  data = g_bytes_new_take (dump_str, strlen (dump_str));
+  send_data_async (dest, port, data, compress);
+  g_bytes_unref (data);
+
+  return TRUE;
+}
+
+static GBytes *
+gzip_compress (const gchar * data, gsize size)
+{
+  GConverter *compressor;
+  GByteArray *out = g_byte_array_new ();
+  GConverterResult res;
+  guint8 buf[16384];
+  gsize bytes_read, bytes_written;
+  GError *err = NULL;
+
+  /* Fastest compression level, this runs on the main loop */
+  compressor =
+      G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, 1));
+  do {
+    res = g_converter_convert (compressor, data, size, buf, sizeof (buf),
+        G_CONVERTER_INPUT_AT_END, &bytes_read, &bytes_written, &err);
+    if (res == G_CONVERTER_ERROR) {
+      GST_ERROR ("ERROR: failed to compress data: %s", err->message);
+      g_clear_error (&err);
+      break;
+    }
+
+    data += bytes_read;
+    size -= bytes_read;
+    g_byte_array_append (out, buf, bytes_written);
+  } while (res != G_CONVERTER_FINISHED);
+  g_object_unref (compressor);
+
+  return g_byte_array_free_to_bytes (out);
+}
+
+typedef struct
+{
+  GstClockTime time;
+  gchar *reason;
+  gsize size;
+  GBytes *data;
+} AutoDump;
+
+static void
+autodump_free (AutoDump * dump)
+{
+  g_free (dump->reason);
+  g_bytes_unref (dump->data);
+  g_slice_free (AutoDump, dump);
+}
+
+static void
+autodump_append_stats (const GValue * item, gpointer user_data)
+{
+  GstElement *element = g_value_get_object (item);
+  GString *dot = user_data;
+  gchar *stats;
+
+  stats = get_element_stats (element, ", ");
+  if (stats) {
+    g_string_append_printf (dot, "  %s: %s\n", GST_OBJECT_NAME (element),
+        stats);
+    g_free (stats);
+  }
+}
+
+/* Stores the graph plus a short statistics snapshot as a comment at the
+ * end, compressed, in a bounded history */
+static void
+autodump_capture (GstLaunchRemote * self, const gchar * reason)
+{
+  AutoDump *dump;
+  GString *dot;
+  gchar *dot_data;
+  gint64 position = -1;
+  GstIterator *it;
+
+  if (self->autodump_size == 0 || !self->pipeline)
+    return;
+
+  dot_data = get_annotated_dot_data (self->pipeline);
+  if (!dot_data)
+    return;
+
+  dot = g_string_new (dot_data);
+  g_free (dot_data);
+
+  gst_element_query_position (self->pipeline, GST_FORMAT_TIME, &position);
+  g_string_append_printf (dot, "/*\n  %s\n  state %s, pending %s, "
+      "position %" GST_TIME_FORMAT "\n", reason,
+      gst_element_state_get_name (GST_STATE (self->pipeline)),
+      gst_element_state_get_name (GST_STATE_PENDING (self->pipeline)),
+      GST_TIME_ARGS (position));
+  it = gst_bin_iterate_recurse (GST_BIN (self->pipeline));
+  gst_iterator_foreach (it, autodump_append_stats, dot);
+  gst_iterator_free (it);
+  g_string_append (dot, "*/\n");
+
+  dump = g_slice_new0 (AutoDump);
+  dump->time = GST_CLOCK_DIFF (start_time, gst_util_get_timestamp ());
+  dump->reason = g_strdup (reason);
+  dump->size = dot->len;
+  dump->data = gzip_compress (dot->str, dot->len);
+  g_string_free (dot, TRUE);
+
+  g_queue_push_tail (&self->autodumps, dump);
+  while (g_queue_get_length (&self->autodumps) > self->autodump_size)
+    autodump_free (g_queue_pop_head (&self->autodumps));
+}
+
+static void
+autodump_set_size (GstLaunchRemote * self, guint size)
+{
+  self->autodump_size = size;
+  while (g_queue_get_length (&self->autodumps) > size)
+    autodump_free (g_queue_pop_head (&self->autodumps));
+}
+
+static void
+send_autodump_list (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  GList *l;
+  guint i = 0;
+  gchar *tmp;
+
+  g_string_append_printf (s, "%u of max. %u snapshots\n",
+      g_queue_get_length (&self->autodumps), self->autodump_size);
+  for (l = self->autodumps.head; l; l = l->next, i++) {
+    AutoDump *dump = l->data;
+
+    g_string_append_printf (s, "  %u: %" GST_TIME_FORMAT " %s (%"
+        G_GSIZE_FORMAT " bytes, %" G_GSIZE_FORMAT " compressed)\n", i,
+        GST_TIME_ARGS (dump->time), dump->reason, dump->size,
+        g_bytes_get_size (dump->data));
+  }
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+}
+
+/* Application callbacks are posted into a mailbox that only keeps the
+ * latest update of each kind, and are delivered from a separate thread
+ * at a capped rate. A slow UI doesn't hold up the bus handling and bursts
+ * collapse into a single callback. With an interval of 0 the callbacks
+ * are called directly from the posting thread */
+typedef enum
+{
+  CALLBACK_MESSAGE,
+  CALLBACK_POSITION,
+  CALLBACK_MEDIA_SIZE
+} CallbackKind;
+
+typedef struct
+{
+  CallbackKind kind;
+  gchar *message;
+  gint values[2];
+} CallbackUpdate;
+
+static void
+callback_update_free (CallbackUpdate * update)
+{
+  g_free (update->message);
+  g_slice_free (CallbackUpdate, update);
+}
+
+static void
+callback_deliver (GstLaunchRemote * self, CallbackUpdate * update)
+{
+  switch (update->kind) {
+    case CALLBACK_MESSAGE:
+      self->app_context.set_message (update->message, self->app_context.app);
+      break;
+    case CALLBACK_POSITION:
+      self->app_context.set_current_position (update->values[0],
+          update->values[1], self->app_context.app);
+      break;
+    case CALLBACK_MEDIA_SIZE:
+      self->app_context.media_size_changed (update->values[0],
+          update->values[1], self->app_context.app);
+      break;
+  }
+  g_atomic_int_inc (&self->callbacks_delivered);
+}
+
+/* Called from the callback thread */
+static gboolean
+callback_flush_cb (GstLaunchRemote * self)
+{
+  guint i;
+
+  /* Updates posted from now on schedule another flush */
+  g_atomic_int_set (&self->callback_flush_pending, FALSE);
+
+  for (i = 0; i < G_N_ELEMENTS (self->callback_mailbox); i++) {
+    CallbackUpdate *update;
+
+    do {
+      update = g_atomic_pointer_get (&self->callback_mailbox[i]);
+    } while (update
+        && !g_atomic_pointer_compare_and_exchange (&self->callback_mailbox[i],
+            update, NULL));
+
+    if (update) {
+      callback_deliver (self, update);
+      callback_update_free (update);
+    }
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the callback thread, once the main thread is gone */
+static gboolean
+callback_shutdown_cb (GstLaunchRemote * self)
+{
+  callback_flush_cb (self);
+  g_main_loop_quit (self->callback_loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from any thread, takes ownership of the update */
+static void
+callback_post (GstLaunchRemote * self, CallbackUpdate * update)
+{
+  gint interval = g_atomic_int_get (&self->callback_interval);
+  gpointer *slot = &self->callback_mailbox[update->kind];
+  CallbackUpdate *old;
+
+  g_atomic_int_inc (&self->callbacks_posted);
+  if (interval == 0) {
+    callback_deliver (self, update);
+    callback_update_free (update);
+    return;
+  }
+
+  do {
+    old = g_atomic_pointer_get (slot);
+  } while (!g_atomic_pointer_compare_and_exchange (slot, old, update));
+  if (old)
+    callback_update_free (old);
+
+  if (g_atomic_int_compare_and_exchange (&self->callback_flush_pending, FALSE,
+          TRUE)) {
+    GSource *source = g_timeout_source_new (interval);
+
+    g_source_set_callback (source, (GSourceFunc) callback_flush_cb, self,
+        NULL);
+    g_source_attach (source, self->callback_context);
+    g_source_unref (source);
+  }
+}
+
+static CallbackUpdate *
+callback_update_new (CallbackKind kind, gint value1, gint value2)
+{
+  CallbackUpdate *update = g_slice_new0 (CallbackUpdate);
+
+  update->kind = kind;
+  update->values[0] = value1;
+  update->values[1] = value2;
+
+  return update;
+}
+
+static gpointer
+callback_thread_func (GstLaunchRemote * self)
+{
+  g_main_context_push_thread_default (self->callback_context);
+  g_main_loop_run (self->callback_loop);
+  g_main_context_pop_thread_default (self->callback_context);
+
+  return NULL;
+}
+
+static void
+set_callback_rate (GstLaunchRemote * self, guint fps)
+{
+  g_atomic_int_set (&self->callback_interval, fps ? MAX (1000 / fps, 1) : 0);
+}
+
+static void
+set_message (GstLaunchRemote * self, const gchar * format, ...)
+{
+  gchar *message;
+  va_list args;
+
+  va_start (args, format);
+  message = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  if (self->app_context.set_message) {
+    CallbackUpdate *update = callback_update_new (CALLBACK_MESSAGE, 0, 0);
+
+    update->message = g_strdup (message);
+    callback_post (self, update);
+  }
+
+  g_free (self->last_message);
+  self->last_message = message;
+}
+
+/* The duration is cached and only queried again when the pipeline prerolled
+ * or posted a duration-changed message */
+static void
+refresh_duration (GstLaunchRemote * self)
+{
+  if (!self->pipeline
+      || !gst_element_query_duration (self->pipeline, GST_FORMAT_TIME,
+          &self->duration)) {
+    GST_WARNING ("Could not query current duration");
+    self->duration = -1;
+  }
+}
+
+static void
+report_position (GstLaunchRemote * self)
+{
+  gint64 duration = 0, position = 0;
+
+  if (!self->app_context.set_current_position)
+    return;
+
+  if (self->pipeline) {
+    if (!gst_element_query_position (self->pipeline, GST_FORMAT_TIME,
+            &position)) {
+      GST_WARNING ("Could not query current position");
+    }
+
+    position = MAX (position, 0);
+    duration = MAX (self->duration, 0);
+  }
+
+  callback_post (self, callback_update_new (CALLBACK_POSITION,
+          position / GST_MSECOND, duration / GST_MSECOND));
+}
+
+static gboolean
+update_position_cb (GstLaunchRemote * self)
+{
+  report_position (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Periodic position updates only happen in PLAYING, in all other states the
+ * position is reported once whenever it changes */
+static void
+position_timer_start (GstLaunchRemote * self)
+{
+  if (self->position_source || self->position_interval == 0)
+    return;
+
+  self->position_source = g_timeout_source_new (self->position_interval);
+  g_source_set_callback (self->position_source,
+      (GSourceFunc) update_position_cb, self, NULL);
+  g_source_attach (self->position_source, self->context);
+}
+
+static void
+position_timer_stop (GstLaunchRemote * self)
+{
+  if (!self->position_source)
+    return;
+
+  g_source_destroy (self->position_source);
+  g_source_unref (self->position_source);
+  self->position_source = NULL;
+}
+
+static void
+position_timer_restart (GstLaunchRemote * self)
+{
+  if (!self->position_source)
+    return;
+
+  position_timer_stop (self);
+  position_timer_start (self);
+}
+
+static GstPad *
+get_sink_pad (GstElement * element)
+{
+  GstPad *sinkpad;
+
+  sinkpad = gst_element_get_static_pad (element, "sink");
+  if (!sinkpad) {
+    sinkpad = gst_element_get_static_pad (element, "video_sink");
+  }
+
+  return sinkpad;
+}
+
+/* The sink that is used for measurements: the video sink if we know it,
+ * otherwise the first sink of the pipeline. NULL without a pipeline */
+static GstElement *
+get_measurement_sink (GstLaunchRemote * self)
+{
+  GstElement *sink = NULL;
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  if (!self->pipeline || !GST_IS_BIN (self->pipeline))
+    return NULL;
+
+  if (self->video_sink)
+    return gst_object_ref (self->video_sink);
+
+  it = gst_bin_iterate_sinks (GST_BIN (self->pipeline));
+  if (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    sink = g_value_dup_object (&item);
+    g_value_unset (&item);
+  }
+  gst_iterator_free (it);
+
+  return sink;
+}
+
+typedef struct
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+} MappedBuffer;
+
+static void
+mapped_buffer_free (MappedBuffer * mapped)
+{
+  gst_buffer_unmap (mapped->buffer, &mapped->map);
+  gst_buffer_unref (mapped->buffer);
+  g_slice_free (MappedBuffer, mapped);
+}
+
+/* Wraps the buffer memory without copying it */
+static GBytes *
+bytes_new_from_buffer (GstBuffer * buffer)
+{
+  MappedBuffer *mapped = g_slice_new (MappedBuffer);
+
+  if (!gst_buffer_map (buffer, &mapped->map, GST_MAP_READ)) {
+    g_slice_free (MappedBuffer, mapped);
+    return NULL;
+  }
+  mapped->buffer = gst_buffer_ref (buffer);
+
+  return g_bytes_new_with_free_func (mapped->map.data, mapped->map.size,
+      (GDestroyNotify) mapped_buffer_free, mapped);
+}
+
+typedef struct
+{
+  GstLaunchRemote *self;
+  GstSample *sample;
+  gboolean png;
+  gchar *dest;
+  gint port;
+  GBytes *data;
+} SnapshotJob;
+
+static void
+snapshot_job_free (SnapshotJob * job)
+{
+  gst_sample_unref (job->sample);
+  g_free (job->dest);
+  if (job->data)
+    g_bytes_unref (job->data);
+  g_slice_free (SnapshotJob, job);
+}
+
+/* Called from a worker thread, so that neither the streaming threads nor
+ * the main loop pay for the conversion */
+static void
+snapshot_encode_thread (GTask * task, gpointer source_object,
+    SnapshotJob * job, GCancellable * cancellable)
+{
+  GstSample *sample;
+  GstBuffer *buffer;
+  GError *err = NULL;
+
+  if (job->png) {
+    GstCaps *caps = gst_caps_new_empty_simple ("image/png");
+
+    sample = gst_video_convert_sample (job->sample, caps, 5 * GST_SECOND,
+        &err);
+    gst_caps_unref (caps);
+    if (!sample) {
+      g_task_return_error (task, err);
+      return;
+    }
+  } else {
+    sample = gst_sample_ref (job->sample);
+  }
+
+  buffer = gst_sample_get_buffer (sample);
+  if (buffer)
+    job->data = bytes_new_from_buffer (buffer);
+  gst_sample_unref (sample);
+
+  if (job->data)
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "Can't map frame");
+}
+
+static void
+snapshot_done_cb (GObject * source_object, GAsyncResult * res,
+    gpointer user_data)
+{
+  SnapshotJob *job = user_data;
+  GError *err = NULL;
+
+  if (g_task_propagate_boolean (G_TASK (res), &err)) {
+    gchar *caps = gst_caps_to_string (gst_sample_get_caps (job->sample));
+
+    write_to_remote (job->self, "SNAPSHOT: sending %" G_GSIZE_FORMAT
+        " bytes %s of %s\n", g_bytes_get_size (job->data),
+        job->png ? "PNG" : "raw", caps);
+    send_data_async (job->dest, job->port, job->data, FALSE);
+    g_free (caps);
+  } else {
+    write_to_remote (job->self, "SNAPSHOT: failed: %s\n", err->message);
+    g_clear_error (&err);
+  }
+
+  snapshot_job_free (job);
+}
+
+/* Takes the last rendered frame from the sink, the pipeline itself is not
+ * touched */
+static gboolean
+send_snapshot (GstLaunchRemote * self, const gchar * dest, gint port,
+    gboolean png)
+{
+  GstElement *sink;
+  GstSample *sample = NULL;
+  SnapshotJob *job;
+  GTask *task;
+
+  if (!self->pipeline) {
+    write_to_remote (self, "SNAPSHOT: no pipeline\n");
+    return FALSE;
+  }
+
+  sink = get_measurement_sink (self);
+  if (!sink) {
+    write_to_remote (self, "SNAPSHOT: no sink\n");
+    return FALSE;
+  }
+
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (sink), "last-sample"))
+    g_object_get (sink, "last-sample", &sample, NULL);
+  gst_object_unref (sink);
+
+  if (!sample || !gst_sample_get_buffer (sample)) {
+    write_to_remote (self, "SNAPSHOT: no frame rendered yet\n");
+    if (sample)
+      gst_sample_unref (sample);
+    return FALSE;
+  }
+
+  job = g_slice_new0 (SnapshotJob);
+  job->self = self;
+  job->sample = sample;
+  job->png = png;
+  job->dest = g_strdup (dest);
+  job->port = port;
+
+  task = g_task_new (NULL, NULL, snapshot_done_cb, job);
+  g_task_set_task_data (task, job, NULL);
+  g_task_run_in_thread (task, (GTaskThreadFunc) snapshot_encode_thread);
+  g_object_unref (task);
+
+  return TRUE;
+}
+
+static gint
+compare_clock_time (gconstpointer a, gconstpointer b)
+{
+  GstClockTime ta = *(const GstClockTime *) a;
+  GstClockTime tb = *(const GstClockTime *) b;
+
+  return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+#define TIME_AS_MS(t) ((gdouble) (t) / GST_MSECOND)
+
+/* Sorts the values in place */
+static gchar *
+format_distribution (GArray * values)
+{
+  GstClockTime *v;
+  GstClockTime sum = 0;
+  guint i, n = values->len;
+
+  if (n == 0)
+    return g_strdup ("no samples");
+
+  g_array_sort (values, compare_clock_time);
+  v = (GstClockTime *) values->data;
+  for (i = 0; i < n; i++)
+    sum += v[i];
+
+#define PERCENTILE(p) v[MIN (n - 1, (n * (p)) / 100)]
+  return g_strdup_printf ("n=%u min=%.3fms p50=%.3fms p90=%.3fms "
+      "p99=%.3fms max=%.3fms mean=%.3fms", n, TIME_AS_MS (v[0]),
+      TIME_AS_MS (PERCENTILE (50)), TIME_AS_MS (PERCENTILE (90)),
+      TIME_AS_MS (PERCENTILE (99)), TIME_AS_MS (v[n - 1]),
+      TIME_AS_MS (sum / n));
+#undef PERCENTILE
+}
+
+/* Protects the 64 bit sum and max of all histograms */
+G_LOCK_DEFINE_STATIC (histograms);
+
+/* Can be called from any thread */
+static void
+histogram_add (GstLaunchRemoteHistogram * h, GstClockTimeDiff value)
+{
+  guint bucket;
+
+  if (value < 0) {
+    g_atomic_int_inc (&h->negative);
+    G_LOCK (histograms);
+    h->negative_sum += -value;
+    G_UNLOCK (histograms);
+    return;
+  }
+
+  bucket = MIN (g_bit_storage (value / GST_USECOND), HISTOGRAM_BUCKETS - 1);
+  g_atomic_int_inc (&h->buckets[bucket]);
+
+  G_LOCK (histograms);
+  h->count++;
+  h->sum += value;
+  h->max = MAX (h->max, (GstClockTime) value);
+  G_UNLOCK (histograms);
+}
+
+static gchar *
+format_histogram (GstLaunchRemoteHistogram * h, const gchar * negative)
+{
+  GString *s = g_string_new (NULL);
+  GstClockTime sum, max;
+  gint count;
+  guint i;
+
+  G_LOCK (histograms);
+  count = h->count;
+  sum = h->sum;
+  max = h->max;
+  G_UNLOCK (histograms);
+
+  g_string_append_printf (s, "n=%d", count);
+  if (count > 0)
+    g_string_append_printf (s, " mean=%.3fms max=%.3fms",
+        TIME_AS_MS (sum / count), TIME_AS_MS (max));
+  if (h->negative > 0)
+    g_string_append_printf (s, " %s=%d", negative, h->negative);
+
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if (h->buckets[i] == 0)
+      continue;
+
+    if (i == HISTOGRAM_BUCKETS - 1)
+      g_string_append_printf (s, "\n    >=%.3fms: %d",
+          TIME_AS_MS ((G_GUINT64_CONSTANT (1) << (i - 1)) * GST_USECOND),
+          h->buckets[i]);
+    else
+      g_string_append_printf (s, "\n    <%.3fms: %d",
+          TIME_AS_MS ((G_GUINT64_CONSTANT (1) << i) * GST_USECOND),
+          h->buckets[i]);
+  }
+
+  return g_string_free (s, FALSE);
+}
+
+static void seek_bench_next (GstLaunchRemote * self, gboolean success);
+
+static void
+seek_measurement_stop (GstLaunchRemote * self)
+{
+  if (self->seek_probe_pad) {
+    gst_pad_remove_probe (self->seek_probe_pad, self->seek_probe_id);
+    gst_object_unref (self->seek_probe_pad);
+    self->seek_probe_pad = NULL;
+    self->seek_probe_id = 0;
+  }
+  self->seek_start_time = GST_CLOCK_TIME_NONE;
+}
+
+/* A seek is done once the pipeline posted ASYNC_DONE and the first buffer
+ * after the flush arrived at the sink */
+static void
+seek_check_done (GstLaunchRemote * self)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (self->seek_start_time) ||
+      !GST_CLOCK_TIME_IS_VALID (self->seek_async_done_time))
+    return;
+
+  if (self->seek_probe_pad
+      && !GST_CLOCK_TIME_IS_VALID (self->seek_first_buffer_time))
+    return;
+
+  self->last_seek_async_done =
+      self->seek_async_done_time - self->seek_start_time;
+  if (self->seek_probe_pad)
+    self->last_seek_first_buffer =
+        self->seek_first_buffer_time - self->seek_start_time;
+  else
+    self->last_seek_first_buffer = GST_CLOCK_TIME_NONE;
+
+  GST_DEBUG ("Seek done: ASYNC_DONE after %" GST_TIME_FORMAT
+      ", first buffer after %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (self->last_seek_async_done),
+      GST_TIME_ARGS (self->last_seek_first_buffer));
+
+  seek_measurement_stop (self);
+
+  if (self->seek_bench_count)
+    seek_bench_next (self, TRUE);
+}
+
+typedef struct
+{
+  GstLaunchRemote *self;
+  guint32 seqnum;
+  GstClockTime time;
+} SeekFirstBuffer;
+
+static void
+seek_first_buffer_free (SeekFirstBuffer * first)
+{
+  g_slice_free (SeekFirstBuffer, first);
+}
+
+/* The time is only stored here, in the main thread. It is ignored if it
+ * belongs to an older seek */
+static gboolean
+seek_first_buffer_cb (SeekFirstBuffer * first)
+{
+  GstLaunchRemote *self = first->self;
+
+  if (first->seqnum != self->seek_seqnum
+      || !GST_CLOCK_TIME_IS_VALID (self->seek_start_time)
+      || GST_CLOCK_TIME_IS_VALID (self->seek_first_buffer_time))
+    return G_SOURCE_REMOVE;
+
+  self->seek_first_buffer_time = first->time;
+  seek_check_done (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the streaming thread. Only buffers after the flush of this
+ * seek are counted, anything before that is still from the old position.
+ * seek_seqnum does not change while the probe is installed */
+static GstPadProbeReturn
+seek_probe_cb (GstPad * pad, GstPadProbeInfo * info, GstLaunchRemote * self)
+{
+  SeekFirstBuffer *first;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_BOTH) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP
+        && gst_event_get_seqnum (event) == self->seek_seqnum)
+      g_atomic_int_set (&self->seek_flushed, TRUE);
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (!g_atomic_int_get (&self->seek_flushed)
+      || !g_atomic_int_compare_and_exchange (&self->seek_first_buffer_posted,
+          FALSE, TRUE))
+    return GST_PAD_PROBE_OK;
+
+  first = g_slice_new (SeekFirstBuffer);
+  first->self = self;
+  first->seqnum = self->seek_seqnum;
+  first->time = gst_util_get_timestamp ();
+  g_main_context_invoke_full (self->context, G_PRIORITY_DEFAULT,
+      (GSourceFunc) seek_first_buffer_cb, first,
+      (GDestroyNotify) seek_first_buffer_free);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void rebuffer_end (GstLaunchRemote * self);
+
+static gboolean
+seek_start (GstLaunchRemote * self, gint position_ms)
+{
+  GstClockTime position;
+  GstElement *sink;
+  GstEvent *event;
+
+  if (!self || !self->pipeline)
+    return FALSE;
+
+  seek_measurement_stop (self);
+  /* Buffering after a seek is like the initial buffering, no rebuffer */
+  rebuffer_end (self);
+  self->played = FALSE;
+
+  position = gst_util_uint64_scale (position_ms, GST_MSECOND, 1);
+  GST_DEBUG ("Seeking to %" GST_TIME_FORMAT, GST_TIME_ARGS (position));
+
+  self->seek_async_done_time = GST_CLOCK_TIME_NONE;
+  self->seek_first_buffer_time = GST_CLOCK_TIME_NONE;
+  self->seek_flushed = FALSE;
+  self->seek_first_buffer_posted = FALSE;
+
+  /* Flushes and ASYNC_DONE of this seek carry its seqnum */
+  event = gst_event_new_seek (1.0, GST_FORMAT_TIME,
+      GST_SEEK_FLAG_FLUSH | self->seek_flags, GST_SEEK_TYPE_SET, position,
+      GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+  self->seek_seqnum = gst_event_get_seqnum (event);
+
+  sink = get_measurement_sink (self);
+  if (sink) {
+    self->seek_probe_pad = get_sink_pad (sink);
+    if (self->seek_probe_pad)
+      self->seek_probe_id =
+          gst_pad_add_probe (self->seek_probe_pad,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST |
+          GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+          (GstPadProbeCallback) seek_probe_cb, self, NULL);
+    gst_object_unref (sink);
+  }
+
+  self->seek_start_time = gst_util_get_timestamp ();
+  if (!gst_element_send_event (self->pipeline, event)) {
+    GST_ERROR ("Seeking failed");
+    set_message (self, "Seeking failed");
+    seek_measurement_stop (self);
+    return FALSE;
+  }
+
+  GST_DEBUG ("Seek successful");
+
+  return TRUE;
+}
+
+static gboolean
+seek_bench_timeout_cb (GstLaunchRemote * self)
+{
+  GST_WARNING ("Benchmark seek %u timed out", self->seek_bench_index);
+  seek_measurement_stop (self);
+  seek_bench_next (self, FALSE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void seek_bench_stop (GstLaunchRemote * self);
+
+/* Starts the next seek that can be started. Seeks that fail right away
+ * are counted here in a loop, a pipeline that can't seek at all would
+ * otherwise recurse once per seek */
+static void
+seek_bench_step (GstLaunchRemote * self)
+{
+  gint64 duration = 0;
+  gint position_ms;
+
+  do {
+    if (!self->pipeline
+        || !gst_element_query_duration (self->pipeline, GST_FORMAT_TIME,
+            &duration) || duration <= 0) {
+      write_to_remote (self, "SEEKBENCH: duration unknown, stopping\n");
+      self->seek_bench_count = 0;
+      return;
+    }
+
+    if (self->seek_bench_random)
+      position_ms = g_random_double_range (0, duration / GST_MSECOND);
+    else
+      position_ms = gst_util_uint64_scale (duration / GST_MSECOND,
+          self->seek_bench_index, self->seek_bench_count);
+
+    /* Completion is only seen from the bus, after the timeout is armed */
+    if (seek_start (self, position_ms)) {
+      self->seek_bench_source = g_timeout_source_new (SEEK_BENCH_TIMEOUT_MS);
+      g_source_set_callback (self->seek_bench_source,
+          (GSourceFunc) seek_bench_timeout_cb, self, NULL);
+      g_source_attach (self->seek_bench_source, self->context);
+      return;
+    }
+
+    self->seek_bench_failures++;
+  } while (++self->seek_bench_index < self->seek_bench_count);
+
+  seek_bench_stop (self);
+}
+
+static void
+seek_bench_report (GstLaunchRemote * self)
+{
+  gchar *async_done, *first_buffer;
+
+  async_done = format_distribution (self->seek_bench_async_done);
+  first_buffer = format_distribution (self->seek_bench_first_buffer);
+  write_to_remote (self, "SEEKBENCH: %u of %u seeks done, %u failed\n"
+      "  ASYNC_DONE: %s\n  first buffer: %s\n", self->seek_bench_index,
+      self->seek_bench_count, self->seek_bench_failures, async_done,
+      first_buffer);
+  g_free (async_done);
+  g_free (first_buffer);
+}
+
+static void
+seek_bench_stop (GstLaunchRemote * self)
+{
+  if (self->seek_bench_source) {
+    g_source_destroy (self->seek_bench_source);
+    g_source_unref (self->seek_bench_source);
+    self->seek_bench_source = NULL;
+  }
+
+  if (self->seek_bench_count) {
+    seek_bench_report (self);
+    self->seek_bench_count = 0;
+  }
+}
+
+static void
+seek_bench_next (GstLaunchRemote * self, gboolean success)
+{
+  if (self->seek_bench_source) {
+    g_source_destroy (self->seek_bench_source);
+    g_source_unref (self->seek_bench_source);
+    self->seek_bench_source = NULL;
+  }
+
+  if (success) {
+    g_array_append_val (self->seek_bench_async_done,
+        self->last_seek_async_done);
+    if (GST_CLOCK_TIME_IS_VALID (self->last_seek_first_buffer))
+      g_array_append_val (self->seek_bench_first_buffer,
+          self->last_seek_first_buffer);
+  } else {
+    self->seek_bench_failures++;
+  }
+
+  if (++self->seek_bench_index >= self->seek_bench_count) {
+    seek_bench_stop (self);
+    return;
+  }
+
+  seek_bench_step (self);
+}
+
+static gboolean
+seek_bench_start (GstLaunchRemote * self, guint count, gboolean random)
+{
+  if (!self->pipeline || count == 0)
+    return FALSE;
+
+  seek_bench_stop (self);
+
+  g_array_set_size (self->seek_bench_async_done, 0);
+  g_array_set_size (self->seek_bench_first_buffer, 0);
+  self->seek_bench_count = count;
+  self->seek_bench_index = 0;
+  self->seek_bench_failures = 0;
+  self->seek_bench_random = random;
+
+  seek_bench_step (self);
+
+  return TRUE;
+}
+
+typedef struct
+{
+  guint messages;
+  guint64 processed;
+  guint64 dropped;
+  gint64 jitter;
+  gint64 max_jitter;
+  gdouble proportion;
+} QosStats;
+
+static void
+qos_stats_free (QosStats * stats)
+{
+  g_slice_free (QosStats, stats);
+}
+
+/* Called from the streaming thread of the measurement sink */
+static GstPadProbeReturn
+pacing_probe_cb (GstPad * pad, GstPadProbeInfo * info, GstLaunchRemote * self)
+{
+  GstClockTime now;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_BOTH) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_QOS) {
+      GstClockTimeDiff diff;
+
+      /* The sink sends QoS upstream after its clock wait, with the jitter
+       * of the buffer against its deadline. Only sinks with "qos" enabled
+       * report this. */
+      gst_event_parse_qos (event, NULL, NULL, &diff, NULL);
+      histogram_add (&self->pacing_lateness, diff);
+    } else if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+      /* Don't count the gap around a seek as an inter-frame interval */
+      self->pacing_last_arrival = GST_CLOCK_TIME_NONE;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* A buffer list, e.g. of RTP packets, counts as a single arrival */
+  now = gst_util_get_timestamp ();
+  if (GST_CLOCK_TIME_IS_VALID (self->pacing_last_arrival))
+    histogram_add (&self->pacing_intervals,
+        GST_CLOCK_DIFF (self->pacing_last_arrival, now));
+  self->pacing_last_arrival = now;
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+pacing_start (GstLaunchRemote * self)
+{
+  GstElement *sink;
+
+  if (self->pacing_pad)
+    return;
+
+  sink = get_measurement_sink (self);
+  if (!sink)
+    return;
+
+  self->pacing_pad = get_sink_pad (sink);
+  if (self->pacing_pad) {
+    self->pacing_last_arrival = GST_CLOCK_TIME_NONE;
+    self->pacing_probe_id =
+        gst_pad_add_probe (self->pacing_pad,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+        GST_PAD_PROBE_TYPE_EVENT_UPSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+        (GstPadProbeCallback) pacing_probe_cb,
+        self, NULL);
+  }
+  gst_object_unref (sink);
+}
+
+static void
+pacing_stop (GstLaunchRemote * self)
+{
+  if (!self->pacing_pad)
+    return;
+
+  gst_pad_remove_probe (self->pacing_pad, self->pacing_probe_id);
+  gst_object_unref (self->pacing_pad);
+  self->pacing_pad = NULL;
+  self->pacing_probe_id = 0;
+}
+
+static void
+pacing_reset (GstLaunchRemote * self)
+{
+  g_hash_table_remove_all (self->qos_stats);
+  G_LOCK (histograms);
+  memset (&self->pacing_intervals, 0, sizeof (GstLaunchRemoteHistogram));
+  memset (&self->pacing_lateness, 0, sizeof (GstLaunchRemoteHistogram));
+  G_UNLOCK (histograms);
+}
+
+static void
+send_pacing_stats (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  gchar *tmp;
+
+  g_hash_table_iter_init (&iter, self->qos_stats);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    QosStats *stats = value;
+
+    g_string_append_printf (s, "QoS %s: messages=%u processed=%"
+        G_GUINT64_FORMAT " dropped=%" G_GUINT64_FORMAT " jitter=%.3fms "
+        "max-jitter=%.3fms proportion=%.3f\n", (const gchar *) key,
+        stats->messages, stats->processed, stats->dropped,
+        TIME_AS_MS (stats->jitter), TIME_AS_MS (stats->max_jitter),
+        stats->proportion);
+  }
+  if (g_hash_table_size (self->qos_stats) == 0)
+    g_string_append (s, "No QoS messages\n");
+
+  tmp = format_histogram (&self->pacing_intervals, "early");
+  g_string_append_printf (s, "Inter-frame interval: %s\n", tmp);
+  g_free (tmp);
+
+  tmp = format_histogram (&self->pacing_lateness, "early");
+  g_string_append_printf (s, "Lateness: %s\n", tmp);
+  g_free (tmp);
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+}
+
+static void
+sync_wait_stop (GstLaunchRemote * self)
+{
+  if (self->sync_handler_id) {
+    g_signal_handler_disconnect (self->net_clock, self->sync_handler_id);
+    self->sync_handler_id = 0;
+  }
+
+  if (self->sync_wait_source) {
+    g_source_destroy (self->sync_wait_source);
+    g_source_unref (self->sync_wait_source);
+    self->sync_wait_source = NULL;
+  }
+}
+
+static void
+playat_stop (GstLaunchRemote * self)
+{
+  if (self->playat_id) {
+    gst_clock_id_unschedule (self->playat_id);
+    gst_clock_id_unref (self->playat_id);
+    self->playat_id = NULL;
+  }
+
+  if (self->playat_clock) {
+    gst_object_unref (self->playat_clock);
+    self->playat_clock = NULL;
+  }
+}
+
+/* Resident set size in KiB, -1 if unknown */
+static gint64
+get_rss_kib (void)
+{
+  gint64 pages = -1;
+#ifdef __linux__
+  gchar *contents, *resident;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL)) {
+    resident = strchr (contents, ' ');
+    if (resident)
+      pages = g_ascii_strtoll (resident + 1, NULL, 10);
+    g_free (contents);
+  }
+  if (pages >= 0)
+    return pages * (sysconf (_SC_PAGESIZE) / 1024);
+#endif
+
+  return pages;
+}
+
+static void
+send_loop_stats (GstLaunchRemote * self, const gchar * result)
+{
+  gchar *drifts = format_histogram (&self->loop_drifts, "faster");
+
+  write_to_remote (self, "LOOP: %s, %u/%u iterations in %.3fms, "
+      "cumulative drift %.3fms\nLOOP: per iteration drift %s\n"
+      "LOOP: RSS %" G_GINT64_FORMAT " KiB at start, %" G_GINT64_FORMAT
+      " KiB now, %" G_GINT64_FORMAT " KiB max\n", result, self->loop_index,
+      self->loop_count, TIME_AS_MS (GST_CLOCK_DIFF (self->loop_start,
+              gst_util_get_timestamp ())), TIME_AS_MS (self->loop_drift),
+      drifts, self->loop_rss_start, self->loop_rss_last, self->loop_rss_max);
+  g_free (drifts);
+}
+
+static void
+loop_finish (GstLaunchRemote * self, const gchar * result)
+{
+  if (self->loop_count == 0)
+    return;
+
+  send_loop_stats (self, result);
+  self->loop_count = 0;
+}
+
+/* Every iteration but the last ends with SEGMENT_DONE instead of EOS. The
+ * last one is played without the segment flag and ends in a real EOS, as
+ * an EOS event sent to the sources can't pass a demuxer that paused after
+ * SEGMENT_DONE */
+static gboolean
+loop_seek (GstLaunchRemote * self, gboolean flush)
+{
+  GstSeekFlags flags = self->seek_flags;
+
+  if (flush)
+    flags |= GST_SEEK_FLAG_FLUSH;
+  if (self->loop_index + 1 < self->loop_count)
+    flags |= GST_SEEK_FLAG_SEGMENT;
+
+  return gst_element_seek (self->pipeline, 1.0, GST_FORMAT_TIME, flags,
+      GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+}
+
+/* The next iteration is started with a non-flushing seek, so the pipeline
+ * keeps running */
+static gboolean
+loop_start (GstLaunchRemote * self, guint count)
+{
+  loop_finish (self, "restarted");
+
+  if (!self->pipeline || GST_STATE (self->pipeline) < GST_STATE_PAUSED) {
+    write_to_remote (self, "LOOP: pipeline not prerolled\n");
+    return FALSE;
+  }
+
+  self->loop_count = count;
+  self->loop_index = 0;
+  if (!loop_seek (self, TRUE)) {
+    self->loop_count = 0;
+    write_to_remote (self, "LOOP: segment seek failed\n");
+    return FALSE;
+  }
+
+  self->loop_drift = 0;
+  memset (&self->loop_drifts, 0, sizeof (self->loop_drifts));
+  self->loop_rss_start = self->loop_rss_last = self->loop_rss_max =
+      get_rss_kib ();
+  self->loop_start = gst_util_get_timestamp ();
+  /* Timing starts with ASYNC_DONE, after the flushing seek prerolled */
+  self->loop_iteration_start = GST_CLOCK_TIME_NONE;
+  play_pipeline (self);
+
+  return TRUE;
+}
+
+/* Position is the end of the iteration that was just played */
+static void
+loop_iteration_done (GstLaunchRemote * self, gint64 position)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+  GstClockTimeDiff drift;
+
+  if (GST_CLOCK_TIME_IS_VALID (self->loop_iteration_start) && position > 0) {
+    drift = GST_CLOCK_DIFF (position, now - self->loop_iteration_start);
+    histogram_add (&self->loop_drifts, drift);
+    self->loop_drift += drift;
+  }
+  self->loop_iteration_start = now;
+  self->loop_index++;
+
+  self->loop_rss_last = get_rss_kib ();
+  self->loop_rss_max = MAX (self->loop_rss_max, self->loop_rss_last);
+}
+
+static void
+segment_done_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  GstFormat format;
+  gint64 position;
+
+  if (self->loop_count == 0
+      || GST_MESSAGE_SRC (msg) != GST_OBJECT (self->pipeline))
+    return;
+
+  gst_message_parse_segment_done (msg, &format, &position);
+  loop_iteration_done (self, format == GST_FORMAT_TIME ? position : -1);
+
+  if (!loop_seek (self, FALSE))
+    loop_finish (self, "seek failed");
+}
+
+/* Called before the pipeline is freed at EOS */
+static void
+loop_eos (GstLaunchRemote * self)
+{
+  gint64 duration = -1;
+
+  if (self->loop_count == 0)
+    return;
+
+  gst_element_query_duration (self->pipeline, GST_FORMAT_TIME, &duration);
+  loop_iteration_done (self, duration);
+  loop_finish (self, self->loop_index >= self->loop_count ? "finished" :
+      "EOS");
+}
+
+/* Seeks to the end without the segment flag to get a real EOS */
+static void
+loop_stop (GstLaunchRemote * self)
+{
+  gint64 duration = -1;
+
+  if (self->loop_count == 0 || !self->pipeline)
+    return;
+
+  loop_finish (self, "stopped");
+  if (gst_element_query_duration (self->pipeline, GST_FORMAT_TIME, &duration)
+      && duration > 0)
+    gst_element_seek (self->pipeline, 1.0, GST_FORMAT_TIME,
+        GST_SEEK_FLAG_FLUSH | self->seek_flags, GST_SEEK_TYPE_SET, duration,
+        GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+}
+
+/* User and system CPU time of the process in microseconds, -1 if unknown */
+static gint64
+get_cpu_time_us (void)
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+        G_USEC_PER_SEC + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+
+  return -1;
+}
+
+static void
+bench_configure_sink (GstElement * sink)
+{
+  GObjectClass *klass = G_OBJECT_GET_CLASS (sink);
+  GstIterator *it;
+
+  if (!GST_OBJECT_FLAG_IS_SET (sink, GST_ELEMENT_FLAG_SINK))
+    return;
+
+  if (g_object_class_find_property (klass, "sync"))
+    g_object_set (sink, "sync", FALSE, NULL);
+  if (g_object_class_find_property (klass, "qos"))
+    g_object_set (sink, "qos", FALSE, NULL);
+
+  it = gst_element_iterate_pads (sink);
+  while (gst_iterator_foreach (it, pad_counter_install,
+          NULL) == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+}
+
+/* Sinks created later by auto-plugging bins, e.g. inside playbin */
+static void
+bench_element_added_cb (GstBin * bin, GstBin * sub_bin, GstElement * element,
+    GstLaunchRemote * self)
+{
+  bench_configure_sink (element);
+}
+
+static void
+bench_collect_sink (const GValue * item, gpointer user_data)
+{
+  GstElement *element = g_value_get_object (item);
+
+  if (GST_OBJECT_FLAG_IS_SET (element, GST_ELEMENT_FLAG_SINK))
+    g_ptr_array_add (user_data, gst_object_ref (element));
+}
+
+static gboolean
+bench_is_video_sink (GstElement * sink)
+{
+  const gchar *klass = gst_element_class_get_metadata (GST_ELEMENT_GET_CLASS
+      (sink), GST_ELEMENT_METADATA_KLASS);
+
+  return klass && strstr (klass, "Sink") && strstr (klass, "Video");
+}
+
+/* Replaces a linked video sink by a fakesink of the same name */
+static gboolean
+bench_replace_sink (GstElement * sink)
+{
+  GstObject *parent = gst_object_get_parent (GST_OBJECT (sink));
+  GstPad *sinkpad = gst_element_get_static_pad (sink, "sink");
+  GstPad *peer = sinkpad ? gst_pad_get_peer (sinkpad) : NULL;
+  GstElement *fakesink = NULL;
+  gchar *name;
+
+  if (GST_IS_BIN (parent) && peer) {
+    name = gst_object_get_name (GST_OBJECT (sink));
+    gst_bin_remove (GST_BIN (parent), sink);
+    fakesink = gst_element_factory_make ("fakesink", name);
+    g_free (name);
+
+    if (fakesink) {
+      GstPad *fakepad;
+
+      gst_bin_add (GST_BIN (parent), fakesink);
+      fakepad = gst_element_get_static_pad (fakesink, "sink");
+      gst_pad_link (peer, fakepad);
+      gst_object_unref (fakepad);
+      bench_configure_sink (fakesink);
+    }
+  }
+
+  if (peer)
+    gst_object_unref (peer);
+  if (sinkpad)
+    gst_object_unref (sinkpad);
+  if (parent)
+    gst_object_unref (parent);
+
+  return fakesink != NULL;
+}
+
+/* Rebuilds the current pipeline with clock sync and QoS disabled on all
+ * sinks and plays it as fast as possible until EOS */
+static gboolean
+bench_fast_start (GstLaunchRemote * self, gboolean fakesink)
+{
+  GPtrArray *sinks;
+  GstIterator *it;
+  gchar *pipeline_string;
+  guint i, replaced = 0;
+
+  if (!self->pipeline_string) {
+    write_to_remote (self, "BENCH: no pipeline\n");
+    return FALSE;
+  }
+
+  pipeline_string = g_strdup (self->pipeline_string);
+  gst_launch_remote_set_pipeline (self, pipeline_string);
+  g_free (pipeline_string);
+  if (!self->pipeline || !GST_IS_BIN (self->pipeline))
+    return FALSE;
+
+  sinks = g_ptr_array_new_with_free_func (gst_object_unref);
+  it = gst_bin_iterate_recurse (GST_BIN (self->pipeline));
+  while (gst_iterator_foreach (it, bench_collect_sink,
+          sinks) == GST_ITERATOR_RESYNC) {
+    g_ptr_array_set_size (sinks, 0);
+    gst_iterator_resync (it);
+  }
+  gst_iterator_free (it);
+
+  for (i = 0; i < sinks->len; i++) {
+    GstElement *sink = g_ptr_array_index (sinks, i);
+
+    if (fakesink && bench_is_video_sink (sink) && bench_replace_sink (sink))
+      replaced++;
+    else
+      bench_configure_sink (sink);
+  }
+  g_ptr_array_unref (sinks);
+
+  /* playbin and friends */
+  if (fakesink && g_object_class_find_property (G_OBJECT_GET_CLASS
+          (self->pipeline), "video-sink")) {
+    GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+
+    if (sink) {
+      g_object_set (self->pipeline, "video-sink", sink, NULL);
+      replaced++;
+    }
+  }
+
+  g_signal_connect (self->pipeline, "deep-element-added",
+      G_CALLBACK (bench_element_added_cb), self);
+  pad_counters_install (self->pipeline);
+
+  write_to_remote (self, "BENCH: running to EOS, %u video sinks replaced\n",
+      replaced);
+  self->bench_fast = TRUE;
+  self->bench_cpu_start = get_cpu_time_us ();
+  play_pipeline (self);
+
+  return TRUE;
+}
+
+static void
+bench_fast_finish (GstLaunchRemote * self, const gchar * result)
+{
+  GString *s;
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  GstClockTimeDiff wall;
+  gdouble seconds, cpu = -1;
+  gint64 cpu_end = get_cpu_time_us ();
+
+  if (!self->bench_fast)
+    return;
+  self->bench_fast = FALSE;
+
+  wall = GST_CLOCK_TIME_IS_VALID (self->last_play_time) ?
+      GST_CLOCK_DIFF (self->last_play_time, gst_util_get_timestamp ()) : 0;
+  seconds = MAX ((gdouble) wall / GST_SECOND, 0.000001);
+  if (self->bench_cpu_start >= 0 && cpu_end >= 0)
+    cpu = (gdouble) (cpu_end - self->bench_cpu_start) / G_USEC_PER_SEC;
+
+  s = g_string_new (NULL);
+  g_string_append_printf (s, "BENCH: FAST %s after %.3fms, CPU time %.3fms "
+      "(%.0f%% of one core)\n", result, TIME_AS_MS (wall), cpu * 1000.0,
+      cpu * 100.0 / seconds);
+
+  it = gst_bin_iterate_recurse (GST_BIN (self->pipeline));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstElement *element = g_value_get_object (&item);
+    ElementCounts counts = { 0, };
+    GstIterator *pads;
+
+    if (GST_OBJECT_FLAG_IS_SET (element, GST_ELEMENT_FLAG_SINK)
+        && !GST_IS_BIN (element)) {
+      pads = gst_element_iterate_pads (element);
+      gst_iterator_foreach (pads, element_counts_add_pad, &counts);
+      gst_iterator_free (pads);
+
+      if (counts.counted)
+        g_string_append_printf (s, "BENCH: %s: %d buffers, %.1f buffers/s, "
+            "%.0f bytes/s\n", GST_OBJECT_NAME (element), counts.buffers_in,
+            counts.buffers_in / seconds, counts.bytes_in / seconds);
+    }
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  write_to_remote (self, "%s", s->str);
+  g_free (self->bench_result);
+  self->bench_result = g_string_free (s, FALSE);
+}
+
+enum
+{
+  REPLACE_WAITING,
+  REPLACE_DRAINING,
+  REPLACE_CANCELLED
+};
+
+/* Protects the EOS probe and drain timeout of a ReplaceJob */
+G_LOCK_DEFINE_STATIC (replace);
+
+/* A running +REPLACE. Shared between the main thread and the streaming
+ * threads of the blocked pad and of the replaced element */
+typedef struct
+{
+  gint ref_count;
+  gint stage;
+  GstLaunchRemote *self;
+  GstElement *element;
+  GstElement *bin;
+  GstPad *upstream;
+  gulong block_id;
+  gulong eos_id;
+  GSource *drain_source;
+  GstClockTime start, blocked, drained;
+} ReplaceJob;
+
+static ReplaceJob *
+replace_job_ref (ReplaceJob * job)
+{
+  g_atomic_int_inc (&job->ref_count);
+  return job;
+}
+
+static void
+replace_job_unref (ReplaceJob * job)
+{
+  if (!g_atomic_int_dec_and_test (&job->ref_count))
+    return;
+
+  gst_object_unref (job->element);
+  gst_object_unref (job->bin);
+  gst_object_unref (job->upstream);
+  g_slice_free (ReplaceJob, job);
+}
+
+/* Removes the EOS probe from the old element and the drain timeout */
+static void
+replace_drain_stop (ReplaceJob * job)
+{
+  G_LOCK (replace);
+  if (job->eos_id) {
+    GstPad *srcpad = gst_element_get_static_pad (job->element, "src");
+
+    gst_pad_remove_probe (srcpad, job->eos_id);
+    gst_object_unref (srcpad);
+    job->eos_id = 0;
+  }
+  if (job->drain_source) {
+    g_source_destroy (job->drain_source);
+    g_source_unref (job->drain_source);
+    job->drain_source = NULL;
+  }
+  G_UNLOCK (replace);
+}
+
+/* Runs in the main thread while upstream is still blocked */
+static gboolean
+replace_swap_cb (ReplaceJob * job)
+{
+  GstLaunchRemote *self = job->self;
+  GstElement *element = job->element;
+  GstObject *parent;
+  GstPad *sinkpad, *srcpad, *downstream, *binpad;
+  gchar *name;
+  gboolean linked;
+
+  if (self->replace != job)
+    return G_SOURCE_REMOVE;
+
+  replace_drain_stop (job);
+
+  parent = gst_object_get_parent (GST_OBJECT (element));
+  sinkpad = gst_element_get_static_pad (element, "sink");
+  srcpad = gst_element_get_static_pad (element, "src");
+  downstream = gst_pad_get_peer (srcpad);
+
+  gst_pad_unlink (job->upstream, sinkpad);
+  if (downstream)
+    gst_pad_unlink (srcpad, downstream);
+  gst_element_set_state (element, GST_STATE_NULL);
+  name = gst_object_get_name (GST_OBJECT (element));
+  gst_bin_remove (GST_BIN (parent), element);
+
+  /* Keep the name so the new bin can be addressed like the old element */
+  gst_object_set_name (GST_OBJECT (job->bin), name);
+  gst_bin_add (GST_BIN (parent), job->bin);
+
+  binpad = gst_element_get_static_pad (job->bin, "sink");
+  linked = gst_pad_link (job->upstream, binpad) == GST_PAD_LINK_OK;
+  gst_object_unref (binpad);
+  if (downstream) {
+    binpad = gst_element_get_static_pad (job->bin, "src");
+    linked &= gst_pad_link (binpad, downstream) == GST_PAD_LINK_OK;
+    gst_object_unref (binpad);
+  }
+  gst_element_sync_state_with_parent (job->bin);
+
+  gst_pad_remove_probe (job->upstream, job->block_id);
+
+  if (linked && !GST_CLOCK_TIME_IS_VALID (job->drained))
+    write_to_remote (self, "REPLACE: %s replaced in %.3fms, blocked after "
+        "%.3fms, not drained after %dms\n", name,
+        TIME_AS_MS (GST_CLOCK_DIFF (job->start, gst_util_get_timestamp ())),
+        TIME_AS_MS (GST_CLOCK_DIFF (job->start, job->blocked)),
+        REPLACE_DRAIN_TIMEOUT_MS);
+  else if (linked)
+    write_to_remote (self, "REPLACE: %s replaced in %.3fms, blocked after "
+        "%.3fms, drained after %.3fms\n", name,
+        TIME_AS_MS (GST_CLOCK_DIFF (job->start, gst_util_get_timestamp ())),
+        TIME_AS_MS (GST_CLOCK_DIFF (job->start, job->blocked)),
+        TIME_AS_MS (GST_CLOCK_DIFF (job->start, job->drained)));
+  else
+    write_to_remote (self, "REPLACE: %s replaced but the new bin could not "
+        "be linked\n", name);
+
+  g_free (name);
+  if (downstream)
+    gst_object_unref (downstream);
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+  gst_object_unref (parent);
+
+  self->replace = NULL;
+  replace_job_unref (job);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* EOS leaving the old element means it has output everything */
+static GstPadProbeReturn
+replace_eos_probe_cb (GstPad * pad, GstPadProbeInfo * info, ReplaceJob * job)
+{
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_EOS)
+    return GST_PAD_PROBE_PASS;
+
+  /* The probe is removed by the swap or by the drain timeout */
+  job->drained = gst_util_get_timestamp ();
+
+  /* Changing the state of the element from its own thread could deadlock */
+  g_main_context_invoke_full (job->self->context, G_PRIORITY_DEFAULT,
+      (GSourceFunc) replace_swap_cb, replace_job_ref (job),
+      (GDestroyNotify) replace_job_unref);
+
+  return GST_PAD_PROBE_DROP;
+}
+
+/* The old element did not forward EOS in time. It already got EOS on its
+ * sink pad and can't take data anymore, so swap it out anyway instead of
+ * keeping upstream blocked forever. Whatever it still held is lost */
+static gboolean
+replace_drain_timeout_cb (ReplaceJob * job)
+{
+  if (job->self->replace != job)
+    return G_SOURCE_REMOVE;
+
+  job->drained = GST_CLOCK_TIME_NONE;
+  return replace_swap_cb (job);
+}
+
+/* Stays blocked until the swap is done */
+static GstPadProbeReturn
+replace_block_cb (GstPad * pad, GstPadProbeInfo * info, ReplaceJob * job)
+{
+  GstPad *srcpad, *sinkpad;
+
+  if (!g_atomic_int_compare_and_exchange (&job->stage, REPLACE_WAITING,
+          REPLACE_DRAINING))
+    return GST_PAD_PROBE_OK;
+
+  job->blocked = gst_util_get_timestamp ();
+
+  G_LOCK (replace);
+  /* Forcefully stopped in the meantime */
+  if (g_atomic_int_get (&job->stage) != REPLACE_DRAINING) {
+    G_UNLOCK (replace);
+    return GST_PAD_PROBE_OK;
+  }
+
+  srcpad = gst_element_get_static_pad (job->element, "src");
+  job->eos_id = gst_pad_add_probe (srcpad,
+      GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) replace_eos_probe_cb, replace_job_ref (job),
+      (GDestroyNotify) replace_job_unref);
+  gst_object_unref (srcpad);
+
+  job->drain_source = g_timeout_source_new (REPLACE_DRAIN_TIMEOUT_MS);
+  g_source_set_callback (job->drain_source,
+      (GSourceFunc) replace_drain_timeout_cb, replace_job_ref (job),
+      (GDestroyNotify) replace_job_unref);
+  g_source_attach (job->drain_source, job->self->context);
+  G_UNLOCK (replace);
+
+  sinkpad = gst_element_get_static_pad (job->element, "sink");
+  gst_pad_send_event (sinkpad, gst_event_new_eos ());
+  gst_object_unref (sinkpad);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Unless forced, only a replacement that is still waiting for data is
+ * cancelled. Once the element is draining it has to be swapped */
+static gboolean
+replace_stop (GstLaunchRemote * self, gboolean force)
+{
+  ReplaceJob *job = self->replace;
+
+  if (!job)
+    return TRUE;
+
+  if (!g_atomic_int_compare_and_exchange (&job->stage, REPLACE_WAITING,
+          REPLACE_CANCELLED) && !force)
+    return FALSE;
+
+  G_LOCK (replace);
+  g_atomic_int_set (&job->stage, REPLACE_CANCELLED);
+  G_UNLOCK (replace);
+  replace_drain_stop (job);
+
+  gst_pad_remove_probe (job->upstream, job->block_id);
+  self->replace = NULL;
+  replace_job_unref (job);
+
+  return TRUE;
+}
+
+static gboolean
+replace_start (GstLaunchRemote * self, const gchar * name,
+    const gchar * description)
+{
+  GstElement *element = NULL, *bin = NULL;
+  GstPad *sinkpad = NULL, *srcpad = NULL, *upstream = NULL;
+  GError *err = NULL;
+  ReplaceJob *job;
+  gboolean ok = FALSE;
+
+  if (self->replace) {
+    write_to_remote (self, "REPLACE: another replacement is running\n");
+    return FALSE;
+  }
+
+  if (self->pipeline && GST_IS_BIN (self->pipeline))
+    element = gst_bin_get_by_name (GST_BIN (self->pipeline), name);
+  if (element) {
+    sinkpad = gst_element_get_static_pad (element, "sink");
+    srcpad = gst_element_get_static_pad (element, "src");
+  }
+  if (sinkpad)
+    upstream = gst_pad_get_peer (sinkpad);
+
+  if (!element) {
+    write_to_remote (self, "REPLACE: no element '%s'\n", name);
+  } else if (!upstream || !srcpad) {
+    write_to_remote (self, "REPLACE: '%s' needs linked sink and src pads\n",
+        name);
+  } else {
+    bin = gst_parse_bin_from_description (description, TRUE, &err);
+    if (err) {
+      write_to_remote (self, "REPLACE: can't build '%s': %s\n", description,
+          err->message);
+      g_clear_error (&err);
+    } else {
+      ok = TRUE;
+    }
+  }
+
+  if (ok) {
+    job = g_slice_new0 (ReplaceJob);
+    job->ref_count = 1;
+    job->stage = REPLACE_WAITING;
+    job->self = self;
+    job->element = gst_object_ref (element);
+    job->bin = gst_object_ref_sink (bin);
+    job->upstream = gst_object_ref (upstream);
+    job->start = gst_util_get_timestamp ();
+    self->replace = job;
+    job->block_id = gst_pad_add_probe (upstream,
+        GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+        (GstPadProbeCallback) replace_block_cb, replace_job_ref (job),
+        (GDestroyNotify) replace_job_unref);
+  } else if (bin) {
+    gst_object_unref (gst_object_ref_sink (bin));
+  }
+
+  if (upstream)
+    gst_object_unref (upstream);
+  if (srcpad)
+    gst_object_unref (srcpad);
+  if (sinkpad)
+    gst_object_unref (sinkpad);
+  if (element)
+    gst_object_unref (element);
+
+  return ok;
+}
+
+static void
+free_pipeline (GstLaunchRemote * self)
+{
+  replace_stop (self, TRUE);
+  loop_finish (self, "aborted");
+  bench_fast_finish (self, "aborted");
+  sync_wait_stop (self);
+  playat_stop (self);
+  seek_bench_stop (self);
+  seek_measurement_stop (self);
+  pacing_stop (self);
+  position_timer_stop (self);
+
+  gst_element_set_state (self->pipeline, GST_STATE_NULL);
+  gst_object_unref (self->pipeline);
+  if (self->video_sink)
+    gst_object_unref (self->video_sink);
+  self->pipeline = NULL;
+  self->video_sink = NULL;
+  self->duration = -1;
+
+  report_position (self);
+}
+
+typedef enum
+{
+  SCRIPT_COMMAND,
+  SCRIPT_WAIT,
+  SCRIPT_WAIT_STATE,
+  SCRIPT_WAIT_EOS,
+  SCRIPT_WAIT_ASYNC_DONE
+} ScriptStepType;
+
+typedef struct
+{
+  ScriptStepType type;
+  gchar *text;
+  GstState state;
+  guint ms;                     /* delay of SCRIPT_WAIT, timeout otherwise */
+  GstClockTime started;
+  GstClockTime finished;
+  const gchar *result;
+} ScriptStep;
+
+static void
+script_step_free (ScriptStep * step)
+{
+  g_free (step->text);
+  g_slice_free (ScriptStep, step);
+}
+
+/* Parses a command, "wait ms" or "wait playing|paused|ready|null|eos|
+ * async-done [timeout-ms]" */
+static ScriptStep *
+script_step_new (const gchar * text)
+{
+  ScriptStep *step = g_slice_new0 (ScriptStep);
+  gchar **args, *endptr = NULL;
+  gboolean ok = TRUE;
+
+  step->text = g_strstrip (g_strdup (text));
+  step->started = GST_CLOCK_TIME_NONE;
+  step->finished = GST_CLOCK_TIME_NONE;
+  step->result = "not run";
+
+  if (!g_str_has_prefix (step->text, "wait ")) {
+    step->type = SCRIPT_COMMAND;
+    if (step->text[0] == '\0' || g_str_has_prefix (step->text, "+SCRIPT")
+        || g_str_has_prefix (step->text, "-SCRIPT")) {
+      script_step_free (step);
+      return NULL;
+    }
+    return step;
+  }
+
+  args = g_strsplit (step->text + sizeof ("wait"), " ", -1);
+  step->ms = SCRIPT_WAIT_TIMEOUT_MS;
+  if (g_strv_length (args) < 1 || g_strv_length (args) > 2) {
+    ok = FALSE;
+  } else if (g_ascii_isdigit (args[0][0])) {
+    step->type = SCRIPT_WAIT;
+    step->ms = g_ascii_strtoull (args[0], &endptr, 10);
+    ok = *endptr == '\0' && args[1] == NULL;
+  } else {
+    if (g_ascii_strcasecmp (args[0], "eos") == 0) {
+      step->type = SCRIPT_WAIT_EOS;
+    } else if (g_ascii_strcasecmp (args[0], "async-done") == 0) {
+      step->type = SCRIPT_WAIT_ASYNC_DONE;
+    } else {
+      step->type = SCRIPT_WAIT_STATE;
+      for (step->state = GST_STATE_NULL; step->state <= GST_STATE_PLAYING;
+          step->state++)
+        if (g_ascii_strcasecmp (args[0],
+                gst_element_state_get_name (step->state)) == 0)
+          break;
+      ok = step->state <= GST_STATE_PLAYING;
+    }
+    if (ok && args[1]) {
+      step->ms = g_ascii_strtoull (args[1], &endptr, 10);
+      ok = g_ascii_isdigit (args[1][0]) && *endptr == '\0';
+    }
+  }
+  g_strfreev (args);
+
+  if (!ok) {
+    script_step_free (step);
+    return NULL;
+  }
+
+  return step;
+}
+
+static void
+script_source_clear (GstLaunchRemote * self)
+{
+  if (!self->script_source)
+    return;
+
+  g_source_destroy (self->script_source);
+  g_source_unref (self->script_source);
+  self->script_source = NULL;
+}
+
+static void
+script_stop (GstLaunchRemote * self)
+{
+  script_source_clear (self);
+  if (self->script) {
+    g_ptr_array_unref (self->script);
+    self->script = NULL;
+  }
+}
+
+/* Step times are relative to the start of the script */
+static void
+script_finish (GstLaunchRemote * self, const gchar * result)
+{
+  GString *s = g_string_new (NULL);
+  gchar *tmp;
+  guint i;
+
+  for (i = 0; i < self->script->len; i++) {
+    ScriptStep *step = g_ptr_array_index (self->script, i);
+
+    g_string_append_printf (s, "SCRIPT: %u '%s' ", i, step->text);
+    if (GST_CLOCK_TIME_IS_VALID (step->started))
+      g_string_append_printf (s, "at %.3fms ",
+          TIME_AS_MS (step->started - self->script_start));
+    if (GST_CLOCK_TIME_IS_VALID (step->finished))
+      g_string_append_printf (s, "took %.3fms ",
+          TIME_AS_MS (step->finished - step->started));
+    g_string_append_printf (s, "%s\n", step->result);
+  }
+  g_string_append_printf (s, "SCRIPT: %s after %.3fms\n", result,
+      TIME_AS_MS (GST_CLOCK_DIFF (self->script_start,
+              gst_util_get_timestamp ())));
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+
+  script_stop (self);
+}
+
+static gboolean script_continue_cb (GstLaunchRemote * self);
+static gboolean script_timeout_cb (GstLaunchRemote * self);
+
+static void
+script_schedule (GstLaunchRemote * self, guint ms, GSourceFunc func)
+{
+  script_source_clear (self);
+  self->script_source = g_timeout_source_new (ms);
+  g_source_set_callback (self->script_source, func, self, NULL);
+  g_source_attach (self->script_source, self->context);
+}
+
+static void
+script_step_done (GstLaunchRemote * self, ScriptStep * step,
+    const gchar * result)
+{
+  step->finished = gst_util_get_timestamp ();
+  step->result = result;
+  self->script_index++;
+}
+
+/* EOS and ASYNC_DONE count if they happened since the last command, even
+ * before the wait step was reached */
+static gboolean
+script_wait_satisfied (GstLaunchRemote * self, ScriptStep * step)
+{
+  GstState state, pending;
+
+  if (step->type == SCRIPT_WAIT_EOS || step->type == SCRIPT_WAIT_ASYNC_DONE) {
+    if (!(self->script_events & (1 << step->type)))
+      return FALSE;
+    self->script_events &= ~(1 << step->type);
+    return TRUE;
+  }
+
+  if (step->type != SCRIPT_WAIT_STATE || !self->pipeline)
+    return step->type == SCRIPT_WAIT_STATE && step->state == GST_STATE_NULL;
+
+  gst_element_get_state (self->pipeline, &state, &pending, 0);
+  return state == step->state && pending == GST_STATE_VOID_PENDING;
+}
+
+/* Runs commands until the next wait */
+static void
+script_run (GstLaunchRemote * self)
+{
+  while (self->script && self->script_index < self->script->len) {
+    ScriptStep *step = g_ptr_array_index (self->script, self->script_index);
+
+    step->started = gst_util_get_timestamp ();
+    if (step->type == SCRIPT_COMMAND) {
+      gchar *line = g_strdup (step->text);
+
+      self->script_events = 0;
+      script_step_done (self, step, handle_command (self, line) ? "OK" :
+          "NOK");
+      g_free (line);
+    } else if (script_wait_satisfied (self, step)) {
+      script_step_done (self, step, "OK");
+    } else {
+      script_schedule (self, step->ms, (GSourceFunc) script_timeout_cb);
+      return;
+    }
+  }
+
+  if (self->script)
+    script_finish (self, "finished");
+}
+
+static gboolean
+script_continue_cb (GstLaunchRemote * self)
+{
+  g_source_unref (self->script_source);
+  self->script_source = NULL;
+  script_run (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+script_timeout_cb (GstLaunchRemote * self)
+{
+  ScriptStep *step = g_ptr_array_index (self->script, self->script_index);
+
+  g_source_unref (self->script_source);
+  self->script_source = NULL;
+
+  if (step->type == SCRIPT_WAIT) {
+    script_step_done (self, step, "OK");
+    script_run (self);
+  } else {
+    script_step_done (self, step, "timeout");
+    script_finish (self, "aborted");
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the bus handlers. The timestamp is taken right away but the
+ * next steps only run from a fresh main loop iteration, as they might
+ * replace the pipeline the handler is still working with */
+static void
+script_event (GstLaunchRemote * self, ScriptStepType type, GstState state)
+{
+  ScriptStep *step;
+
+  if (!self->script || self->script_index >= self->script->len)
+    return;
+
+  step = g_ptr_array_index (self->script, self->script_index);
+  if (step->type != type || (type == SCRIPT_WAIT_STATE
+          && state != step->state) || !self->script_source) {
+    self->script_events |= 1 << type;
+    return;
+  }
+
+  script_step_done (self, step, "OK");
+  script_schedule (self, 0, (GSourceFunc) script_continue_cb);
+}
+
+static void
+script_error (GstLaunchRemote * self)
+{
+  ScriptStep *step;
+
+  if (!self->script || !self->script_source
+      || self->script_index >= self->script->len)
+    return;
+
+  step = g_ptr_array_index (self->script, self->script_index);
+  if (step->type == SCRIPT_WAIT)
+    return;
+
+  script_step_done (self, step, "error");
+  script_finish (self, "aborted");
+}
+
+/* Steps are separated by ';' */
+static gboolean
+script_start (GstLaunchRemote * self, const gchar * text)
+{
+  gchar **steps = g_strsplit (text, ";", -1);
+  GPtrArray *script;
+  guint i;
+
+  script = g_ptr_array_new_with_free_func ((GDestroyNotify) script_step_free);
+  for (i = 0; steps[i]; i++) {
+    ScriptStep *step = script_step_new (steps[i]);
+
+    if (!step) {
+      g_ptr_array_unref (script);
+      g_strfreev (steps);
+      return FALSE;
+    }
+    g_ptr_array_add (script, step);
+  }
+  g_strfreev (steps);
+
+  script_stop (self);
+  self->script = script;
+  self->script_index = 0;
+  self->script_events = 0;
+  self->script_start = gst_util_get_timestamp ();
+  /* Only start after the command was acknowledged */
+  script_schedule (self, 0, (GSourceFunc) script_continue_cb);
+
+  return TRUE;
+}
+
+static void
+error_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  GError *err;
+  gchar *debug_info;
+
+  gst_message_parse_error (msg, &err, &debug_info);
+  set_message (self, "Error received from element %s: %s",
+      GST_OBJECT_NAME (msg->src), err->message);
+  autodump_capture (self, self->last_message);
+  g_clear_error (&err);
+  g_free (debug_info);
+
+  self->target_state = GST_STATE_NULL;
+  free_pipeline (self);
+  self->last_eos_time = gst_util_get_timestamp ();
+  script_error (self);
+}
+
+static void
+eos_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  bench_fast_finish (self, "reached EOS");
+  loop_eos (self);
+  self->target_state = GST_STATE_NULL;
+  free_pipeline (self);
+  self->last_eos_time = gst_util_get_timestamp ();
+  script_event (self, SCRIPT_WAIT_EOS, GST_STATE_VOID_PENDING);
+}
+
+/* Checks if the rest of the media will be downloaded before playback
+ * catches up with the download, based on the download rate estimate */
+static gboolean
+buffering_download_covered (GstLaunchRemote * self)
+{
+  GstQuery *query;
+  GstBufferingMode mode;
+  GstFormat format;
+  gint avg_in, avg_out;
+  gint64 buffering_left, start, stop, estimated_total, position = -1;
+  gboolean covered = FALSE;
+
+  query = gst_query_new_buffering (GST_FORMAT_TIME);
+  if (gst_element_query (self->pipeline, query)) {
+    gst_query_parse_buffering_stats (query, &mode, &avg_in, &avg_out,
+        &buffering_left);
+    gst_query_parse_buffering_range (query, &format, &start, &stop,
+        &estimated_total);
+    self->buffering_rate = avg_in;
+
+    if (estimated_total >= 0 && self->duration > 0
+        && gst_element_query_position (self->pipeline, GST_FORMAT_TIME,
+            &position) && position >= 0) {
+      gint64 remaining_ms = (self->duration - position) / GST_MSECOND;
+
+      GST_DEBUG ("Download needs %" G_GINT64_FORMAT "ms more, %"
+          G_GINT64_FORMAT "ms left to play at %d bytes/s", estimated_total,
+          remaining_ms, avg_in);
+      covered = estimated_total <= remaining_ms;
+    }
+  }
+  gst_query_unref (query);
+
+  return covered;
+}
+
+static void
+rebuffer_end (GstLaunchRemote * self)
+{
+  GstClockTime duration;
+
+  if (!self->buffering_paused)
+    return;
+
+  duration = GST_CLOCK_DIFF (self->rebuffer_start, gst_util_get_timestamp ());
+  self->buffering_paused = FALSE;
+  if (!self->buffering_initial) {
+    self->rebuffer_total += duration;
+    self->rebuffer_max = MAX (self->rebuffer_max, duration);
+  }
+  GST_DEBUG ("Buffered for %" GST_TIME_FORMAT, GST_TIME_ARGS (duration));
+}
+
+/* Playback is only paused below the low watermark and resumed once the
+ * high watermark is reached, or if the download will finish in time
+ * anyway. This avoids flapping between PAUSED and PLAYING. Buffering
+ * before playback started, after a seek or while paused is not counted as
+ * rebuffer */
+static void
+buffering_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  gint percent;
+
+  if (self->is_live)
+    return;
+
+  gst_message_parse_buffering (msg, &percent);
+  g_atomic_int_set (&self->buffering_percent, percent);
+
+  if (self->target_state < GST_STATE_PAUSED)
+    return;
+
+  if (!self->buffering_paused) {
+    if (percent >= self->buffering_low && percent < 100)
+      return;
+
+    if (percent < 100) {
+      self->buffering_paused = TRUE;
+      self->buffering_initial = !self->played
+          || self->target_state < GST_STATE_PLAYING;
+      self->rebuffer_start = gst_util_get_timestamp ();
+      if (!self->buffering_initial)
+        self->rebuffer_count++;
+      gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
+      set_message (self, "Buffering %d%%", percent);
+      return;
+    }
+  } else if (percent < self->buffering_high
+      && !buffering_download_covered (self)) {
+    set_message (self, "Buffering %d%%", percent);
+    return;
+  }
+
+  rebuffer_end (self);
+  if (self->target_state >= GST_STATE_PLAYING) {
+    gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
+  } else {
+    set_message (self, "Buffering complete");
+  }
+}
+
+static void
+send_buffering_stats (GstLaunchRemote * self)
+{
+  GstClockTime total = self->rebuffer_total;
+
+  if (self->buffering_paused && !self->buffering_initial)
+    total += GST_CLOCK_DIFF (self->rebuffer_start, gst_util_get_timestamp ());
+
+  write_to_remote (self, "Watermarks %u%%/%u%%, currently %s at %d%%\n"
+      "%u rebuffers, total %" GST_TIME_FORMAT ", max %" GST_TIME_FORMAT
+      ", download rate %d bytes/s\n", self->buffering_low,
+      self->buffering_high, self->buffering_paused ? "buffering" : "playing",
+      g_atomic_int_get (&self->buffering_percent), self->rebuffer_count,
+      GST_TIME_ARGS (total), GST_TIME_ARGS (self->rebuffer_max),
+      self->buffering_rate);
+}
+
+static void
+async_done_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  if (GST_MESSAGE_SRC (msg) != GST_OBJECT (self->pipeline))
+    return;
+
+  /* The position jumped after a seek, report it right away and rearm the
+   * timer from here */
+  report_position (self);
+  position_timer_restart (self);
+  script_event (self, SCRIPT_WAIT_ASYNC_DONE, GST_STATE_VOID_PENDING);
+
+  if (self->loop_count && !GST_CLOCK_TIME_IS_VALID (self->loop_iteration_start))
+    self->loop_iteration_start = gst_util_get_timestamp ();
+
+  /* A late ASYNC_DONE of an earlier, e.g. timed out, seek doesn't count */
+  if (!GST_CLOCK_TIME_IS_VALID (self->seek_start_time) ||
+      GST_CLOCK_TIME_IS_VALID (self->seek_async_done_time) ||
+      gst_message_get_seqnum (msg) != self->seek_seqnum)
+    return;
+
+  self->seek_async_done_time = gst_util_get_timestamp ();
+  seek_check_done (self);
+}
+
+static void
+qos_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  QosStats *stats;
+  GstFormat format;
+  guint64 processed, dropped;
+  gint64 jitter;
+  gdouble proportion;
+  gint quality;
+
+  stats = g_hash_table_lookup (self->qos_stats, GST_OBJECT_NAME (msg->src));
+  if (!stats) {
+    stats = g_slice_new0 (QosStats);
+    g_hash_table_insert (self->qos_stats,
+        g_strdup (GST_OBJECT_NAME (msg->src)), stats);
+  }
+
+  /* Processed and dropped are running totals of the element */
+  gst_message_parse_qos_stats (msg, &format, &processed, &dropped);
+  gst_message_parse_qos_values (msg, &jitter, &proportion, &quality);
+
+  stats->messages++;
+  if (format == GST_FORMAT_BUFFERS || format == GST_FORMAT_DEFAULT) {
+    stats->processed = processed;
+    stats->dropped = dropped;
+  }
+  stats->jitter = jitter;
+  stats->max_jitter = MAX (stats->max_jitter, ABS (jitter));
+  stats->proportion = proportion;
+}
+
+static void
+duration_changed_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  refresh_duration (self);
+  report_position (self);
+}
+
+static void
+clock_lost_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  if (self->target_state >= GST_STATE_PLAYING) {
+    gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
+    gst_element_set_state (self->pipeline, GST_STATE_PLAYING);
+  }
+}
+
+static void
+check_media_size (GstLaunchRemote * self)
+{
+  GstPad *video_sink_pad;
+  GstCaps *caps;
+  GstVideoInfo info;
+
+  if (!self->video_sink || !self->app_context.media_size_changed)
+    return;
+
+  /* Retrieve the Caps at the entrance of the video sink */
+  video_sink_pad = gst_element_get_static_pad (self->video_sink, "sink");
+  if (!video_sink_pad)
+    return;
+
+  caps = gst_pad_get_current_caps (video_sink_pad);
+
+  if (gst_video_info_from_caps (&info, caps)) {
+    info.width = info.width * info.par_n / info.par_d;
+    GST_DEBUG ("Media size is %dx%d, notifying application", info.width,
+        info.height);
+
+    callback_post (self, callback_update_new (CALLBACK_MEDIA_SIZE,
+            info.width, info.height));
+  }
+
+  gst_caps_unref (caps);
+  gst_object_unref (video_sink_pad);
+}
+
+static void
+notify_caps_cb (GObject * object, GParamSpec * pspec, GstLaunchRemote * self)
+{
+  check_media_size (self);
+}
+
+static GQuark pool_stats_quark;
+static GQuark pool_probe_quark;
+
+/* Overrides for allocation queries crossing the sink pad of an element */
+typedef struct
+{
+  guint min;
+  guint max;
+  guint size;                   /* 0 keeps the proposed size */
+} PoolRule;
+
+static void
+pool_rule_free (PoolRule * rule)
+{
+  g_slice_free (PoolRule, rule);
+}
+
+typedef struct
+{
+  GMutex lock;
+  guint64 acquired;
+  guint outstanding;
+  guint peak;
+  guint waits;
+  GstClockTime wait_time;
+  GstClockTime max_wait;
+} PoolStats;
+
+static void
+pool_stats_free (PoolStats * stats)
+{
+  g_mutex_clear (&stats->lock);
+  g_slice_free (PoolStats, stats);
+}
+
+/* Pools seen in allocation queries. They are not renamed as most of them
+ * belong to other elements */
+typedef struct
+{
+  GstBufferPool *pool;
+  gchar *name;
+} PoolEntry;
+
+static void
+pool_entry_free (PoolEntry * entry)
+{
+  gst_object_unref (entry->pool);
+  g_free (entry->name);
+  g_slice_free (PoolEntry, entry);
+}
+
+/* Called from the streaming thread. A waiting acquire is detected by
+ * first trying without waiting */
+static GstFlowReturn
+instrumented_pool_acquire_buffer (GstBufferPool * pool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params)
+{
+  GstBufferPoolClass *parent_class =
+      g_type_class_peek_parent (G_OBJECT_GET_CLASS (pool));
+  PoolStats *stats = g_object_get_qdata (G_OBJECT (pool), pool_stats_quark);
+  GstBufferPoolAcquireParams try_params = { 0, };
+  GstClockTime wait_start = GST_CLOCK_TIME_NONE;
+  GstFlowReturn ret;
+
+  if (params)
+    try_params = *params;
+  try_params.flags |= GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+  ret = parent_class->acquire_buffer (pool, buffer, &try_params);
+  if (ret == GST_FLOW_EOS && (!params
+          || !(params->flags & GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT))) {
+    wait_start = gst_util_get_timestamp ();
+    ret = parent_class->acquire_buffer (pool, buffer, params);
+  }
+
+  g_mutex_lock (&stats->lock);
+  if (GST_CLOCK_TIME_IS_VALID (wait_start)) {
+    GstClockTime waited =
+        GST_CLOCK_DIFF (wait_start, gst_util_get_timestamp ());
+
+    stats->waits++;
+    stats->wait_time += waited;
+    stats->max_wait = MAX (stats->max_wait, waited);
+  }
+  if (ret == GST_FLOW_OK) {
+    stats->acquired++;
+    stats->outstanding++;
+    stats->peak = MAX (stats->peak, stats->outstanding);
+  }
+  g_mutex_unlock (&stats->lock);
+
+  return ret;
+}
+
+static void
+instrumented_pool_release_buffer (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstBufferPoolClass *parent_class =
+      g_type_class_peek_parent (G_OBJECT_GET_CLASS (pool));
+  PoolStats *stats = g_object_get_qdata (G_OBJECT (pool), pool_stats_quark);
+
+  g_mutex_lock (&stats->lock);
+  if (stats->outstanding > 0)
+    stats->outstanding--;
+  g_mutex_unlock (&stats->lock);
+
+  parent_class->release_buffer (pool, buffer);
+}
+
+static void
+instrumented_pool_class_init (GstBufferPoolClass * klass)
+{
+  klass->acquire_buffer = instrumented_pool_acquire_buffer;
+  klass->release_buffer = instrumented_pool_release_buffer;
+}
+
+G_LOCK_DEFINE_STATIC (instrumented_pool_types);
+
+/* Subclass of the plain or the video buffer pool that only adds counting,
+ * the pool otherwise behaves exactly like the one it replaces */
+static GType
+instrumented_pool_get_type (GType parent)
+{
+  static GType buffer_pool_type = 0, video_buffer_pool_type = 0;
+  gboolean video = parent == GST_TYPE_VIDEO_BUFFER_POOL;
+  GType *type = video ? &video_buffer_pool_type : &buffer_pool_type;
+
+  G_LOCK (instrumented_pool_types);
+  if (!*type) {
+    GTypeQuery query;
+
+    g_type_query (parent, &query);
+    *type = g_type_register_static_simple (parent,
+        video ? "GstLaunchRemoteVideoBufferPool" :
+        "GstLaunchRemoteBufferPool", query.class_size,
+        (GClassInitFunc) instrumented_pool_class_init, query.instance_size,
+        NULL, 0);
+  }
+  G_UNLOCK (instrumented_pool_types);
+
+  return *type;
+}
+
+/* Keeps a reference to the pool for reporting until the next pipeline.
+ * The same pool shows up again with every reconfiguration */
+static void
+pool_register (GstLaunchRemote * self, GstBufferPool * pool,
+    GstElement * element)
+{
+  PoolEntry *entry;
+  guint i;
+
+  g_mutex_lock (&self->pools_lock);
+  for (i = 0; i < self->pools->len; i++) {
+    entry = g_ptr_array_index (self->pools, i);
+    if (entry->pool == pool)
+      break;
+  }
+
+  if (i == self->pools->len) {
+    entry = g_slice_new (PoolEntry);
+    entry->pool = gst_object_ref (pool);
+    entry->name = g_strdup_printf ("%s-pool%u", GST_OBJECT_NAME (element),
+        self->pools->len);
+    g_ptr_array_add (self->pools, entry);
+  }
+  g_mutex_unlock (&self->pools_lock);
+}
+
+static GstBufferPool *
+pool_new_instrumented (GstLaunchRemote * self, GstElement * element,
+    GType parent)
+{
+  GstBufferPool *pool;
+  PoolStats *stats;
+
+  pool = g_object_new (instrumented_pool_get_type (parent), NULL);
+  gst_object_ref_sink (pool);
+
+  stats = g_slice_new0 (PoolStats);
+  g_mutex_init (&stats->lock);
+  g_object_set_qdata_full (G_OBJECT (pool), pool_stats_quark, stats,
+      (GDestroyNotify) pool_stats_free);
+  pool_register (self, pool, element);
+
+  return pool;
+}
+
+/* Called after the allocation query was answered downstream. Applies the
+ * overrides and replaces plain pools, or adds one if none was proposed,
+ * with an instrumented pool. Special pools (e.g. for hardware memory)
+ * are kept but can only be reported, not measured */
+static GstPadProbeReturn
+pool_probe_cb (GstPad * pad, GstPadProbeInfo * info, GstLaunchRemote * self)
+{
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+  GstElement *element;
+  PoolRule *found, rule;
+  GstCaps *caps;
+  GstVideoInfo vinfo;
+  gboolean is_video;
+  guint i;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION)
+    return GST_PAD_PROBE_OK;
+
+  element = gst_pad_get_parent_element (pad);
+  if (!element)
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&self->pools_lock);
+  found = g_hash_table_lookup (self->pool_rules, GST_OBJECT_NAME (element));
+  if (found)
+    rule = *found;
+  g_mutex_unlock (&self->pools_lock);
+
+  if (!found) {
+    gst_object_unref (element);
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_query_parse_allocation (query, &caps, NULL);
+  is_video = caps && gst_video_info_from_caps (&vinfo, caps);
+  if (gst_query_get_n_allocation_pools (query) == 0) {
+    /* Without a size a pool can't be configured, leave the query alone */
+    if (!is_video && !rule.size) {
+      gst_object_unref (element);
+      return GST_PAD_PROBE_OK;
+    }
+    gst_query_add_allocation_pool (query, NULL, is_video ? vinfo.size : 0, 0,
+        0);
+  }
+
+  for (i = 0; i < gst_query_get_n_allocation_pools (query); i++) {
+    GstBufferPool *pool;
+    guint size, min, max;
+
+    gst_query_parse_nth_allocation_pool (query, i, &pool, &size, &min, &max);
+    GST_DEBUG ("Overriding pool %" GST_PTR_FORMAT " of %s: size %u->%u "
+        "min %u->%u max %u->%u", pool, GST_OBJECT_NAME (element), size,
+        rule.size ? rule.size : size, min, rule.min, max, rule.max);
+    if (rule.size)
+      size = rule.size;
+
+    if (!pool || G_OBJECT_TYPE (pool) == GST_TYPE_BUFFER_POOL
+        || G_OBJECT_TYPE (pool) == GST_TYPE_VIDEO_BUFFER_POOL) {
+      GType parent = pool ? G_OBJECT_TYPE (pool) : is_video ?
+          GST_TYPE_VIDEO_BUFFER_POOL : GST_TYPE_BUFFER_POOL;
+
+      if (pool)
+        gst_object_unref (pool);
+      pool = pool_new_instrumented (self, element, parent);
+    } else {
+      pool_register (self, pool, element);
+    }
+
+    gst_query_set_nth_allocation_pool (query, i, pool, size, rule.min,
+        rule.max);
+    gst_object_unref (pool);
+  }
+  gst_object_unref (element);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+pool_probe_install (GstLaunchRemote * self, GstElement * element,
+    gboolean reconfigure)
+{
+  GstPad *sinkpad = get_sink_pad (element);
+
+  if (sinkpad) {
+    if (!g_object_get_qdata (G_OBJECT (sinkpad), pool_probe_quark)) {
+      g_object_set_qdata (G_OBJECT (sinkpad), pool_probe_quark,
+          GINT_TO_POINTER (TRUE));
+      gst_pad_add_probe (sinkpad,
+          GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL,
+          (GstPadProbeCallback) pool_probe_cb, self, NULL);
+    }
+    /* Make upstream renegotiate its allocation */
+    if (reconfigure)
+      gst_pad_push_event (sinkpad, gst_event_new_reconfigure ());
+    gst_object_unref (sinkpad);
+  }
+}
+
+static void
+pool_rule_install (GstLaunchRemote * self, const gchar * name,
+    gboolean reconfigure)
+{
+  GstElement *element;
+
+  if (!self->pipeline || !GST_IS_BIN (self->pipeline))
+    return;
+
+  element = gst_bin_get_by_name (GST_BIN (self->pipeline), name);
+  if (element) {
+    pool_probe_install (self, element, reconfigure);
+    gst_object_unref (element);
+  }
+}
+
+/* Elements created later by auto-plugging bins, e.g. decoders in decodebin.
+ * Might be called from a streaming thread */
+static void
+pool_element_added_cb (GstBin * bin, GstBin * sub_bin, GstElement * element,
+    GstLaunchRemote * self)
+{
+  gboolean found;
+
+  g_mutex_lock (&self->pools_lock);
+  found = g_hash_table_contains (self->pool_rules, GST_OBJECT_NAME (element));
+  g_mutex_unlock (&self->pools_lock);
+
+  if (found)
+    pool_probe_install (self, element, FALSE);
+}
+
+static void
+pool_rules_install (GstLaunchRemote * self)
+{
+  GHashTableIter iter;
+  gpointer key;
+
+  if (GST_IS_BIN (self->pipeline))
+    g_signal_connect (self->pipeline, "deep-element-added",
+        G_CALLBACK (pool_element_added_cb), self);
+
+  g_hash_table_iter_init (&iter, self->pool_rules);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    pool_rule_install (self, key, FALSE);
+}
+
+/* Parses "element min max [size]" */
+static gboolean
+pool_rule_set (GstLaunchRemote * self, const gchar * args)
+{
+  gchar **argv = g_strsplit (args, " ", -1);
+  guint argc = g_strv_length (argv);
+  guint64 values[3] = { 0, };
+  gboolean ret = argc == 3 || argc == 4;
+  guint i;
+
+  for (i = 1; ret && i < argc; i++) {
+    gchar *endptr = NULL;
+
+    values[i - 1] = g_ascii_strtoull (argv[i], &endptr, 10);
+    ret = endptr != argv[i] && *endptr == '\0' && values[i - 1] <= G_MAXUINT;
+  }
+
+  /* A maximum of 0 means unlimited */
+  if (ret && (values[1] == 0 || values[0] <= values[1])) {
+    PoolRule *rule = g_slice_new0 (PoolRule);
+
+    rule->min = values[0];
+    rule->max = values[1];
+    rule->size = values[2];
+
+    g_mutex_lock (&self->pools_lock);
+    g_hash_table_insert (self->pool_rules, g_strdup (argv[0]), rule);
+    g_mutex_unlock (&self->pools_lock);
+    pool_rule_install (self, argv[0], TRUE);
+  } else {
+    ret = FALSE;
+  }
+  g_strfreev (argv);
+
+  return ret;
+}
+
+static void
+send_pool_stats (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  gchar *tmp;
+  guint i;
+
+  g_mutex_lock (&self->pools_lock);
+  g_hash_table_iter_init (&iter, self->pool_rules);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    PoolRule *rule = value;
+
+    g_string_append_printf (s, "Override %s: min=%u max=%u size=%u\n",
+        (const gchar *) key, rule->min, rule->max, rule->size);
+  }
+
+  for (i = 0; i < self->pools->len; i++) {
+    PoolEntry *entry = g_ptr_array_index (self->pools, i);
+    GstBufferPool *pool = entry->pool;
+    GstStructure *config = gst_buffer_pool_get_config (pool);
+    PoolStats *stats = g_object_get_qdata (G_OBJECT (pool), pool_stats_quark);
+    guint size = 0, min = 0, max = 0;
+
+    gst_buffer_pool_config_get_params (config, NULL, &size, &min, &max);
+    gst_structure_free (config);
+
+    g_string_append_printf (s, "Pool %s: %s size=%u min=%u max=%u",
+        entry->name, gst_buffer_pool_is_active (pool) ? "active" :
+        "inactive", size, min, max);
+    if (stats) {
+      g_mutex_lock (&stats->lock);
+      g_string_append_printf (s, " acquired=%" G_GUINT64_FORMAT
+          " outstanding=%u peak=%u waits=%u wait=%.3fms max-wait=%.3fms\n",
+          stats->acquired, stats->outstanding, stats->peak, stats->waits,
+          TIME_AS_MS (stats->wait_time), TIME_AS_MS (stats->max_wait));
+      g_mutex_unlock (&stats->lock);
+    } else {
+      g_string_append_printf (s, " (%s, not instrumented)\n",
+          G_OBJECT_TYPE_NAME (pool));
+    }
+  }
+  g_mutex_unlock (&self->pools_lock);
+
+  if (s->len == 0)
+    g_string_append (s, "No pool overrides\n");
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+}
+
+/* Placement applied to streaming threads of an element when they start.
+ * Threads that are already running are not touched */
+typedef struct
+{
+  guint64 cpus;                 /* 0 keeps the inherited affinity */
+  gint policy;                  /* -1 keeps the inherited policy */
+  gint priority;
+  gboolean set_nice;
+  gint nice;
+  guint applied;
+  guint failed;
+} ThreadRule;
+
+static void
+thread_rule_free (ThreadRule * rule)
+{
+  g_slice_free (ThreadRule, rule);
+}
+
+/* Parses CPU lists like "0-3,6" */
+static gboolean
+parse_cpu_list (const gchar * str, guint64 * cpus)
+{
+  gchar **ranges = g_strsplit (str, ",", -1);
+  gboolean ret = TRUE;
+  guint i;
+
+  *cpus = 0;
+  for (i = 0; ranges[i] && ret; i++) {
+    gchar *endptr = NULL;
+    guint64 first, last;
+
+    first = last = g_ascii_strtoull (ranges[i], &endptr, 10);
+    if (endptr == ranges[i]) {
+      ret = FALSE;
+    } else if (*endptr == '-') {
+      gchar *start = endptr + 1;
+
+      last = g_ascii_strtoull (start, &endptr, 10);
+      ret = endptr != start;
+    }
+    if (*endptr != '\0' || first > last || last >= 64)
+      ret = FALSE;
+
+    for (; ret && first <= last; first++)
+      *cpus |= G_GUINT64_CONSTANT (1) << first;
+  }
+  g_strfreev (ranges);
+
+  return ret && *cpus != 0;
+}
+
+/* Called from the thread that is to be configured */
+static gboolean
+thread_rule_apply (ThreadRule * rule, const gchar * name)
+{
+#ifdef __linux__
+  gboolean ret = TRUE;
+  gint res;
+
+  if (rule->cpus) {
+    cpu_set_t set;
+    guint i;
+
+    CPU_ZERO (&set);
+    for (i = 0; i < 64; i++)
+      if (rule->cpus & (G_GUINT64_CONSTANT (1) << i))
+        CPU_SET (i, &set);
+
+    if (sched_setaffinity (0, sizeof (set), &set) != 0) {
+      GST_WARNING ("Failed to set affinity of %s: %s", name,
+          g_strerror (errno));
+      ret = FALSE;
+    }
+  }
+
+  if (rule->policy != -1) {
+    struct sched_param param;
+
+    memset (&param, 0, sizeof (param));
+    param.sched_priority = rule->priority;
+    res = pthread_setschedparam (pthread_self (), rule->policy, &param);
+    if (res != 0) {
+      GST_WARNING ("Failed to set scheduling policy of %s: %s", name,
+          g_strerror (res));
+      ret = FALSE;
+    }
+  }
+
+  if (rule->set_nice
+      && setpriority (PRIO_PROCESS, syscall (SYS_gettid), rule->nice) != 0) {
+    GST_WARNING ("Failed to set nice level of %s: %s", name,
+        g_strerror (errno));
+    ret = FALSE;
+  }
+
+  return ret;
+#else
+  GST_WARNING ("Thread placement not supported on this platform");
+  return FALSE;
+#endif
+}
+
+/* Stream-status enter messages are posted from the new streaming thread
+ * itself, so it can be configured right here */
+static void
+stream_status_apply (GstLaunchRemote * self, GstMessage * msg)
+{
+  GstStreamStatusType type;
+  GstElement *owner;
+  ThreadRule *rule;
+
+  gst_message_parse_stream_status (msg, &type, &owner);
+  if (type != GST_STREAM_STATUS_TYPE_ENTER)
+    return;
+
+  g_mutex_lock (&self->threads_lock);
+  self->streaming_threads++;
+  rule = g_hash_table_lookup (self->thread_rules, GST_OBJECT_NAME (owner));
+  if (!rule)
+    rule = g_hash_table_lookup (self->thread_rules, "*");
+  if (rule) {
+    if (thread_rule_apply (rule, GST_OBJECT_NAME (owner)))
+      rule->applied++;
+    else
+      rule->failed++;
+  }
+  g_mutex_unlock (&self->threads_lock);
+}
+
+/* Parses "element cpus [nice level|fifo priority|rr priority]" */
+static gboolean
+thread_rule_set (GstLaunchRemote * self, const gchar * args)
+{
+  gchar **argv = g_strsplit (args, " ", -1);
+  guint argc = g_strv_length (argv);
+  ThreadRule *rule;
+  gboolean ret = TRUE;
+
+  if (argc != 2 && argc != 4) {
+    g_strfreev (argv);
+    return FALSE;
+  }
+
+  rule = g_slice_new0 (ThreadRule);
+  rule->policy = -1;
+
+  if (strcmp (argv[1], "-") != 0 && !parse_cpu_list (argv[1], &rule->cpus))
+    ret = FALSE;
+
+  if (ret && argc == 4) {
+    gchar *endptr = NULL;
+    gint64 value = g_ascii_strtoll (argv[3], &endptr, 10);
+
+    if (*endptr != '\0' || endptr == argv[3]) {
+      ret = FALSE;
+    } else if (strcmp (argv[2], "nice") == 0 && value >= -20 && value <= 19) {
+      rule->set_nice = TRUE;
+      rule->nice = value;
+#ifdef __linux__
+    } else if (strcmp (argv[2], "fifo") == 0 && value >= 1 && value <= 99) {
+      rule->policy = SCHED_FIFO;
+      rule->priority = value;
+    } else if (strcmp (argv[2], "rr") == 0 && value >= 1 && value <= 99) {
+      rule->policy = SCHED_RR;
+      rule->priority = value;
+#endif
+    } else {
+      ret = FALSE;
+    }
+  }
+
+  if (ret) {
+    g_mutex_lock (&self->threads_lock);
+    g_hash_table_insert (self->thread_rules, g_strdup (argv[0]), rule);
+    g_mutex_unlock (&self->threads_lock);
+  } else {
+    thread_rule_free (rule);
+  }
+  g_strfreev (argv);
+
+  return ret;
+}
+
+static void
+send_thread_rules (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  gchar *tmp;
+
+  g_mutex_lock (&self->threads_lock);
+  g_string_append_printf (s, "%u streaming threads started\n",
+      self->streaming_threads);
+  g_hash_table_iter_init (&iter, self->thread_rules);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    ThreadRule *rule = value;
+
+    g_string_append_printf (s, "%s: cpus=0x%" G_GINT64_MODIFIER "x",
+        (const gchar *) key, rule->cpus);
+    if (rule->set_nice)
+      g_string_append_printf (s, " nice=%d", rule->nice);
+    if (rule->policy != -1)
+      g_string_append_printf (s, " %s=%d",
+#ifdef __linux__
+          rule->policy == SCHED_FIFO ? "fifo" : "rr",
+#else
+          "policy",
+#endif
+          rule->priority);
+    g_string_append_printf (s, " applied=%u failed=%u\n", rule->applied,
+        rule->failed);
+  }
+  g_mutex_unlock (&self->threads_lock);
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+}
+
+static guint
+message_type_index (GstMessage * msg)
+{
+  return g_bit_storage (GST_MESSAGE_TYPE (msg)) - 1;
+}
+
+/* Called from whatever thread posted the message. Only the window handle
+ * request and thread placement have to be handled synchronously,
+ * everything else is counted and passed on to the bus watch */
+static GstBusSyncReply
+bus_sync_handler (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  guint type = message_type_index (msg);
+
+  if (type < G_N_ELEMENTS (self->bus_message_counts))
+    g_atomic_int_inc (&self->bus_message_counts[type]);
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_STREAM_STATUS)
+    stream_status_apply (self, msg);
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ELEMENT
+      && gst_is_video_overlay_prepare_window_handle_message (msg)) {
+    GstElement *element = GST_ELEMENT (GST_MESSAGE_SRC (msg));
+    GstPad *sinkpad;
+
+    /* Store video sink for later usage and set window on it if we have one */
+    gst_object_replace ((GstObject **) & self->video_sink,
+        (GstObject *) element);
+
+    sinkpad = get_sink_pad (element);
+    if (sinkpad) {
+      g_signal_connect (sinkpad, "notify::caps", (GCallback) notify_caps_cb,
+          self);
+      gst_object_unref (sinkpad);
+    }
+
+    gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (element),
+        (guintptr) self->window_handle);
+    gst_message_unref (msg);
+    return GST_BUS_DROP;
+  }
+
+  return GST_BUS_PASS;
+}
+
+/* Notify UI about pipeline state changes */
+static void stall_probes_set (GstLaunchRemote * self, gboolean install);
+
+static void
+state_changed_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  GstState old_state, new_state, pending_state;
+
+  gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
+  /* Only pay attention to messages coming from the pipeline, not its children */
+  if (GST_MESSAGE_SRC (msg) == GST_OBJECT (self->pipeline)) {
+    set_message (self, "State changed to %s",
+        gst_element_state_get_name (new_state));
+    autodump_capture (self, self->last_message);
+    if (pending_state == GST_STATE_VOID_PENDING)
+      script_event (self, SCRIPT_WAIT_STATE, new_state);
+
+    if (new_state == GST_STATE_PLAYING) {
+      self->played = TRUE;
+      if (!GST_CLOCK_TIME_IS_VALID (self->ttff_playing))
+        self->ttff_playing = gst_util_get_timestamp ();
+      if (self->playat_clock && !self->playat_id && !self->playat_reported) {
+        write_to_remote (self, "PLAYAT: reached PLAYING %.3fms late\n",
+            TIME_AS_MS (GST_CLOCK_DIFF (self->playat_time,
+                    gst_clock_get_time (self->playat_clock))));
+        self->playat_reported = TRUE;
+      }
+      position_timer_start (self);
+    } else {
+      position_timer_stop (self);
+      report_position (self);
+    }
+
+    /* The Ready to Paused state change is particularly interesting: */
+    if (old_state == GST_STATE_READY && new_state == GST_STATE_PAUSED) {
+      if (!GST_CLOCK_TIME_IS_VALID (self->ttff_prerolled))
+        self->ttff_prerolled = gst_util_get_timestamp ();
+      /* By now the sink already knows the media size */
+      check_media_size (self);
+      /* ... and the duration should be known */
+      refresh_duration (self);
+      report_position (self);
+      /* ... and the video sink is known */
+      pacing_start (self);
+      if (self->pad_counters)
+        pad_counters_install (self->pipeline);
+      if (self->stall_timeout)
+        stall_probes_set (self, TRUE);
+    }
+  }
+}
+
+static gboolean
+net_clock_bus_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  const GstStructure *s;
+  gboolean synced = FALSE;
+  gint64 discont = 0;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ELEMENT)
+    return TRUE;
+
+  s = gst_message_get_structure (msg);
+  if (!s || !gst_structure_has_name (s, "gst-netclock-statistics"))
+    return TRUE;
+
+  self->net_clock_updates++;
+  if (gst_structure_get_int64 (s, "discontinuity", &discont) && discont != 0) {
+    self->net_clock_discontinuities++;
+    self->net_clock_max_discontinuity =
+        MAX (self->net_clock_max_discontinuity, (GstClockTime) ABS (discont));
+  }
+
+  if (gst_structure_get_boolean (s, "synchronised", &synced) && synced
+      && !GST_CLOCK_TIME_IS_VALID (self->net_clock_sync_time))
+    self->net_clock_sync_time = gst_util_get_timestamp ();
+
+  if (self->net_clock_stats)
+    gst_structure_free (self->net_clock_stats);
+  self->net_clock_stats = gst_structure_copy (s);
+
+  return TRUE;
+}
+
+static void
+net_clock_clear (GstLaunchRemote * self)
+{
+  if (self->net_clock_bus_source) {
+    g_source_destroy (self->net_clock_bus_source);
+    g_source_unref (self->net_clock_bus_source);
+    self->net_clock_bus_source = NULL;
+  }
+
+  if (self->net_clock_bus) {
+    gst_object_unref (self->net_clock_bus);
+    self->net_clock_bus = NULL;
+  }
+
+  if (self->net_clock_stats) {
+    gst_structure_free (self->net_clock_stats);
+    self->net_clock_stats = NULL;
+  }
+
+  if (self->net_clock)
+    gst_object_unref (self->net_clock);
+  self->net_clock = NULL;
+}
+
+static void
+net_clock_set (GstLaunchRemote * self, const gchar * host, gint port)
+{
+  GST_DEBUG ("Setting netclock %s %d", host, port);
+
+  self->net_clock = gst_net_client_clock_new ("netclock", host, port, 0);
+  self->net_clock_start_time = gst_util_get_timestamp ();
+  self->net_clock_sync_time = GST_CLOCK_TIME_NONE;
+  self->net_clock_updates = 0;
+  self->net_clock_discontinuities = 0;
+  self->net_clock_max_discontinuity = 0;
+
+  /* The clock posts its statistics on this bus */
+  self->net_clock_bus = gst_bus_new ();
+  g_object_set (self->net_clock, "bus", self->net_clock_bus, NULL);
+  self->net_clock_bus_source = gst_bus_create_watch (self->net_clock_bus);
+  g_source_set_callback (self->net_clock_bus_source,
+      (GSourceFunc) net_clock_bus_cb, self, NULL);
+  g_source_attach (self->net_clock_bus_source, self->context);
+}
+
+static void
+send_net_clock_stats (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  const GstStructure *stats = self->net_clock_stats;
+  gchar *tmp;
+
+  if (!self->net_clock) {
+    g_string_append (s, "No net clock\n");
+  } else {
+    g_string_append_printf (s, "Net clock: %s",
+        gst_clock_is_synced (self->net_clock) ? "synced" : "not synced");
+    if (GST_CLOCK_TIME_IS_VALID (self->net_clock_sync_time))
+      g_string_append_printf (s, " after %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (self->net_clock_sync_time -
+              self->net_clock_start_time));
+    g_string_append_printf (s, ", %u updates, %u discontinuities (max %"
+        GST_TIME_FORMAT ")\n", self->net_clock_updates,
+        self->net_clock_discontinuities,
+        GST_TIME_ARGS (self->net_clock_max_discontinuity));
+  }
+
+  if (stats) {
+    GstClockTime rtt = GST_CLOCK_TIME_NONE, local = GST_CLOCK_TIME_NONE,
+        remote = GST_CLOCK_TIME_NONE;
+    gint64 offset = 0;
+    gdouble rate = 0, r_squared = 0;
+
+    gst_structure_get_clock_time (stats, "rtt-average", &rtt);
+    gst_structure_get_clock_time (stats, "local", &local);
+    gst_structure_get_clock_time (stats, "remote", &remote);
+    gst_structure_get_int64 (stats, "local-clock-offset", &offset);
+    gst_structure_get_double (stats, "rate", &rate);
+    gst_structure_get_double (stats, "r-squared", &r_squared);
+
+    g_string_append_printf (s, "  RTT %.3fms, local %" GST_TIME_FORMAT
+        ", remote %" GST_TIME_FORMAT ", local-remote offset %.3fms, "
+        "rate %.9f, r-squared %.6f\n", TIME_AS_MS (rtt),
+        GST_TIME_ARGS (local), GST_TIME_ARGS (remote), TIME_AS_MS (offset),
+        rate, r_squared);
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (self->last_sync_wait))
+    g_string_append_printf (s, "Last wait for sync before PLAY: %"
+        GST_TIME_FORMAT "%s\n", GST_TIME_ARGS (self->last_sync_wait),
+        self->last_sync_wait_timed_out ? " (timed out)" : "");
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+}
+
+/* The clock that pipelines are forced to use, if any */
+static GstClock *
+get_forced_clock (GstLaunchRemote * self)
+{
+  if (self->net_clock)
+    return self->net_clock;
+
+  return self->provided_clock;
+}
+
+static void
+time_provider_stop (GstLaunchRemote * self)
+{
+  if (self->time_provider) {
+    gst_object_unref (self->time_provider);
+    self->time_provider = NULL;
+  }
+
+  if (self->provided_clock) {
+    gst_object_unref (self->provided_clock);
+    self->provided_clock = NULL;
+  }
+  self->provided_port = 0;
+}
+
+/* Serves the net clock if there is one, otherwise the system clock, and
+ * makes all pipelines use that clock */
+static gboolean
+time_provider_start (GstLaunchRemote * self, gint port)
+{
+  GstClock *clock;
+
+  time_provider_stop (self);
+
+  if (self->net_clock)
+    clock = gst_object_ref (self->net_clock);
+  else
+    clock = gst_system_clock_obtain ();
+
+  self->time_provider = gst_net_time_provider_new (clock, NULL, port);
+  if (!self->time_provider) {
+    GST_ERROR ("ERROR: Can't provide net time on port %d", port);
+    gst_object_unref (clock);
+    return FALSE;
+  }
+
+  GST_DEBUG ("Providing net time of %s on port %d", GST_OBJECT_NAME (clock),
+      port);
+  self->provided_clock = clock;
+  self->provided_port = port;
+
+  if (self->pipeline)
+    gst_pipeline_use_clock (GST_PIPELINE (self->pipeline),
+        get_forced_clock (self));
+
+  return TRUE;
+}
+
+static void
+clock_test_stop (GstLaunchRemote * self)
+{
+  if (self->clock_test_source) {
+    g_source_destroy (self->clock_test_source);
+    g_source_unref (self->clock_test_source);
+    self->clock_test_source = NULL;
+  }
+
+  if (self->clock_test_clocks) {
+    g_ptr_array_unref (self->clock_test_clocks);
+    self->clock_test_clocks = NULL;
+  }
+
+  if (self->clock_test_providers) {
+    g_ptr_array_unref (self->clock_test_providers);
+    self->clock_test_providers = NULL;
+  }
+}
+
+static void
+clock_test_report (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  GstClockTimeDiff min = G_MAXINT64, max = G_MININT64, sum = 0;
+  guint i, synced = 0;
+  gchar *tmp;
+
+  g_string_append_printf (s, "NETCLOCKTEST: %u clients after %"
+      GST_TIME_FORMAT "\n", self->clock_test_clocks->len,
+      GST_TIME_ARGS (GST_CLOCK_DIFF (self->clock_test_start,
+              gst_util_get_timestamp ())));
+
+  for (i = 0; i < self->clock_test_clocks->len; i++) {
+    GstClock *clock = g_ptr_array_index (self->clock_test_clocks, i);
+    GstClockTime reference, client;
+    GstClockTimeDiff offset;
+
+    reference = gst_clock_get_time (self->provided_clock);
+    client = gst_clock_get_time (clock);
+    offset = GST_CLOCK_DIFF (reference, client);
+
+    if (gst_clock_is_synced (clock))
+      synced++;
+    min = MIN (min, offset);
+    max = MAX (max, offset);
+    sum += offset;
+
+    g_string_append_printf (s, "  client %u: %s, offset %.3fms\n", i,
+        gst_clock_is_synced (clock) ? "synced" : "not synced",
+        TIME_AS_MS (offset));
+  }
+
+  if (self->clock_test_clocks->len > 0)
+    g_string_append_printf (s, "  %u synced, offset min %.3fms max %.3fms "
+        "mean %.3fms spread %.3fms\n", synced, TIME_AS_MS (min),
+        TIME_AS_MS (max), TIME_AS_MS (sum / (gint64) i), TIME_AS_MS (max - min));
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+}
+
+static gboolean
+clock_test_check_cb (GstLaunchRemote * self)
+{
+  GstClockTimeDiff elapsed;
+  gboolean all_synced = TRUE;
+  guint i;
+
+  for (i = 0; i < self->clock_test_clocks->len; i++)
+    all_synced &=
+        gst_clock_is_synced (g_ptr_array_index (self->clock_test_clocks, i));
+
+  elapsed = GST_CLOCK_DIFF (self->clock_test_start, gst_util_get_timestamp ());
+  if (!all_synced && elapsed < self->clock_test_timeout * GST_MSECOND)
+    return G_SOURCE_CONTINUE;
+
+  clock_test_report (self);
+  clock_test_stop (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Syncs a number of net client clocks in this process to the served clock
+ * over loopback and reports how far they are apart. Client clocks for the
+ * same address and port share one internal clock, so every client gets its
+ * own provider of the served clock on a free port */
+static gboolean
+clock_test_start (GstLaunchRemote * self, guint count, guint timeout)
+{
+  guint i;
+
+  if (!self->time_provider || count == 0)
+    return FALSE;
+
+  clock_test_stop (self);
+
+  self->clock_test_clocks =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_object_unref);
+  self->clock_test_providers =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_object_unref);
+  for (i = 0; i < count; i++) {
+    GstNetTimeProvider *provider;
+    gchar *name;
+    gint port = 0;
+
+    provider = gst_net_time_provider_new (self->provided_clock, "127.0.0.1",
+        0);
+    if (!provider) {
+      write_to_remote (self, "NETCLOCKTEST: can't create provider %u\n", i);
+      clock_test_stop (self);
+      return FALSE;
+    }
+    g_object_get (provider, "port", &port, NULL);
+    g_ptr_array_add (self->clock_test_providers, provider);
+
+    name = g_strdup_printf ("netclocktest%u", i);
+    g_ptr_array_add (self->clock_test_clocks,
+        gst_net_client_clock_new (name, "127.0.0.1", port, 0));
+    g_free (name);
+  }
+
+  self->clock_test_start = gst_util_get_timestamp ();
+  self->clock_test_timeout = timeout;
+  self->clock_test_source = g_timeout_source_new (50);
+  g_source_set_callback (self->clock_test_source,
+      (GSourceFunc) clock_test_check_cb, self, NULL);
+  g_source_attach (self->clock_test_source, self->context);
+
+  return TRUE;
+}
+
+static void set_playing (GstLaunchRemote * self);
+
+/* A fired +PLAYAT, tagged with its clock ID */
+typedef struct
+{
+  GstLaunchRemote *self;
+  GstClockID id;
+} PlayAtFire;
+
+static void
+playat_fire_free (PlayAtFire * fire)
+{
+  gst_clock_id_unref (fire->id);
+  g_slice_free (PlayAtFire, fire);
+}
+
+static gboolean
+playat_fire_cb (PlayAtFire * fire)
+{
+  GstLaunchRemote *self = fire->self;
+  GstClockTimeDiff late;
+
+  /* Unscheduled or replaced in the meantime */
+  if (!self->playat_id || fire->id != self->playat_id)
+    return G_SOURCE_REMOVE;
+
+  set_playing (self);
+  late = GST_CLOCK_DIFF (self->playat_time,
+      gst_clock_get_time (self->playat_clock));
+  write_to_remote (self, "PLAYAT: PLAYING requested %.3fms late\n",
+      TIME_AS_MS (late));
+
+  /* Keep the clock until the state change completed */
+  gst_clock_id_unref (self->playat_id);
+  self->playat_id = NULL;
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the clock's thread */
+static gboolean
+playat_clock_cb (GstClock * clock, GstClockTime time, GstClockID id,
+    GstLaunchRemote * self)
+{
+  PlayAtFire *fire = g_slice_new (PlayAtFire);
+
+  fire->self = self;
+  fire->id = gst_clock_id_ref (id);
+  g_main_context_invoke_full (self->context, G_PRIORITY_DEFAULT,
+      (GSourceFunc) playat_fire_cb, fire, (GDestroyNotify) playat_fire_free);
+
+  return TRUE;
+}
+
+/* Prerolls right away and goes to PLAYING at the given time of the
+ * pipeline's clock */
+static gboolean
+playat_start (GstLaunchRemote * self, GstClockTime time)
+{
+  GstClock *clock;
+
+  if (!self->pipeline_string)
+    return FALSE;
+
+  playat_stop (self);
+  pause_pipeline (self);
+  if (!self->pipeline)
+    return FALSE;
+
+  clock = get_forced_clock (self);
+  if (clock)
+    clock = gst_object_ref (clock);
+  else
+    clock = gst_system_clock_obtain ();
+  gst_pipeline_use_clock (GST_PIPELINE (self->pipeline), clock);
+
+  if (!GST_CLOCK_TIME_IS_VALID (self->base_time)) {
+    gst_element_set_base_time (self->pipeline, time);
+    gst_element_set_start_time (self->pipeline, GST_CLOCK_TIME_NONE);
+  }
+
+  GST_DEBUG ("Going to PLAYING at %" GST_TIME_FORMAT " of %s, now %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (time), GST_OBJECT_NAME (clock),
+      GST_TIME_ARGS (gst_clock_get_time (clock)));
+
+  self->playat_clock = clock;
+  self->playat_time = time;
+  self->playat_reported = FALSE;
+  self->playat_id = gst_clock_new_single_shot_id (clock, time);
+  gst_clock_id_wait_async (self->playat_id,
+      (GstClockCallback) playat_clock_cb, self, NULL);
+
+  return TRUE;
+}
+
+/* Identifies the sync wait a callback belongs to */
+typedef struct
+{
+  GstLaunchRemote *self;
+  guint seqnum;
+} SyncWaitTag;
+
+static SyncWaitTag *
+sync_wait_tag_new (GstLaunchRemote * self, guint seqnum)
+{
+  SyncWaitTag *tag = g_slice_new (SyncWaitTag);
+
+  tag->self = self;
+  tag->seqnum = seqnum;
+
+  return tag;
+}
+
+static void
+sync_wait_tag_free (SyncWaitTag * tag)
+{
+  g_slice_free (SyncWaitTag, tag);
+}
+
+static gboolean
+sync_wait_done_cb (SyncWaitTag * tag)
+{
+  GstLaunchRemote *self = tag->self;
+
+  /* Stopped or restarted in the meantime */
+  if (!self->sync_wait_source || tag->seqnum != self->sync_wait_seqnum)
+    return G_SOURCE_REMOVE;
+
+  self->last_sync_wait =
+      GST_CLOCK_DIFF (self->sync_wait_start, gst_util_get_timestamp ());
+  self->last_sync_wait_timed_out = !gst_clock_is_synced (self->net_clock);
+  GST_DEBUG ("Waited %" GST_TIME_FORMAT " for the net clock to sync%s",
+      GST_TIME_ARGS (self->last_sync_wait),
+      self->last_sync_wait_timed_out ? ", timed out" : "");
+
+  sync_wait_stop (self);
+  set_playing (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the clock's thread */
+static void
+net_clock_synced_cb (GstClock * clock, gboolean synced, SyncWaitTag * tag)
+{
+  if (synced)
+    g_main_context_invoke_full (tag->self->context, G_PRIORITY_DEFAULT,
+        (GSourceFunc) sync_wait_done_cb,
+        sync_wait_tag_new (tag->self, tag->seqnum),
+        (GDestroyNotify) sync_wait_tag_free);
+}
+
+static void
+sync_wait_start (GstLaunchRemote * self)
+{
+  GST_DEBUG ("Waiting up to %ums for the net clock to sync",
+      self->sync_timeout);
+
+  self->sync_wait_seqnum++;
+  self->sync_wait_start = gst_util_get_timestamp ();
+  self->sync_wait_source = g_timeout_source_new (self->sync_timeout);
+  g_source_set_callback (self->sync_wait_source,
+      (GSourceFunc) sync_wait_done_cb,
+      sync_wait_tag_new (self, self->sync_wait_seqnum),
+      (GDestroyNotify) sync_wait_tag_free);
+  g_source_attach (self->sync_wait_source, self->context);
+
+  self->sync_handler_id = g_signal_connect_data (self->net_clock, "synced",
+      (GCallback) net_clock_synced_cb,
+      sync_wait_tag_new (self, self->sync_wait_seqnum),
+      (GClosureNotify) sync_wait_tag_free, 0);
+
+  /* Might have synced in the meantime */
+  if (gst_clock_is_synced (self->net_clock))
+    g_main_context_invoke_full (self->context, G_PRIORITY_DEFAULT,
+        (GSourceFunc) sync_wait_done_cb,
+        sync_wait_tag_new (self, self->sync_wait_seqnum),
+        (GDestroyNotify) sync_wait_tag_free);
+}
+
+/* Check if all conditions are met to report GStreamer as initialized.
+ * These conditions will change depending on the application */
+static void
+check_initialization_complete (GstLaunchRemote * self)
+{
+  if (!self->initialized && self->window_handle && self->main_loop) {
+    GST_DEBUG
+        ("Initialization complete, notifying application. window handle: %p",
+        (gpointer) self->window_handle);
+
+    if (self->app_context.initialized)
+      self->app_context.initialized (self->app_context.app);
+    self->initialized = TRUE;
+  }
+}
+
+static void
+handle_eof (GstLaunchRemote * self)
+{
+  g_object_unref (self->distream);
+  g_object_unref (self->connection);
+  self->distream = NULL;
+  self->ostream = NULL;
+  self->connection = NULL;
+}
+
+static void
+write_to_remote (GstLaunchRemote * self, const gchar * format, ...)
+{
+  gchar *tmp;
+  va_list varargs;
+
+  if (self->connection == NULL)
+    return;
 
   va_start (varargs, format);
   tmp = g_strdup_vprintf (format, varargs);
   va_end (varargs);
 
-  g_mutex_lock (&self->lock);
-  g_output_stream_write_all (self->ostream, tmp, strlen (tmp), NULL, NULL,
-      NULL);
-  g_mutex_unlock (&self->lock);
+  g_mutex_lock (&self->lock);
+  g_output_stream_write_all (self->ostream, tmp, strlen (tmp), NULL, NULL,
+      NULL);
+  g_mutex_unlock (&self->lock);
+
+  g_free (tmp);
+}
+
+static gchar *
+escape_label (const gchar * value)
+{
+  GString *s = g_string_new (NULL);
+
+  for (; *value; value++) {
+    if (*value == '\\' || *value == '"')
+      g_string_append_c (s, '\\');
+    if (*value == '\n')
+      g_string_append (s, "\\n");
+    else
+      g_string_append_c (s, *value);
+  }
+
+  return g_string_free (s, FALSE);
+}
+
+static void
+append_histogram_metric (GString * s, const gchar * name, const gchar * help,
+    GstLaunchRemoteHistogram * h)
+{
+  gint cumulative = g_atomic_int_get (&h->negative);
+  GstClockTimeDiff sum;
+  guint i;
+
+  /* Negative samples are counted in the lowest bucket, so they have to be
+   * part of the sum too */
+  G_LOCK (histograms);
+  sum = GST_CLOCK_DIFF (h->negative_sum, h->sum);
+  G_UNLOCK (histograms);
+
+  g_string_append_printf (s, "# HELP %s %s\n# TYPE %s histogram\n", name,
+      help, name);
+  for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+    cumulative += g_atomic_int_get (&h->buckets[i]);
+    g_string_append_printf (s, "%s_bucket{le=\"%g\"} %d\n", name,
+        (gdouble) (G_GUINT64_CONSTANT (1) << i) / G_USEC_PER_SEC, cumulative);
+  }
+  cumulative += g_atomic_int_get (&h->buckets[HISTOGRAM_BUCKETS - 1]);
+  g_string_append_printf (s, "%s_bucket{le=\"+Inf\"} %d\n", name,
+      cumulative);
+  g_string_append_printf (s, "%s_sum %g\n%s_count %d\n", name,
+      (gdouble) sum / GST_SECOND, name, cumulative);
+}
+
+#define METRIC(s, name, type, help) \
+  g_string_append_printf (s, "# HELP gst_launch_remote_" name " " help \
+      "\n# TYPE gst_launch_remote_" name " " type "\n")
+
+/* Prometheus text exposition format */
+static gchar *
+build_metrics (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  gint64 position = -1, duration = -1;
+  GstState state = GST_STATE_VOID_PENDING;
+  gdouble playing = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
+
+  if (self->pipeline) {
+    gst_element_query_position (self->pipeline, GST_FORMAT_TIME, &position);
+    gst_element_query_duration (self->pipeline, GST_FORMAT_TIME, &duration);
+    state = GST_STATE (self->pipeline);
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (self->last_play_time)) {
+    GstClockTime end = GST_CLOCK_TIME_IS_VALID (self->last_eos_time) ?
+        self->last_eos_time : gst_util_get_timestamp ();
+
+    playing = (gdouble) GST_CLOCK_DIFF (self->last_play_time, end) / GST_SECOND;
+  }
+
+  METRIC (s, "position_seconds", "gauge", "Current playback position");
+  g_string_append_printf (s, "gst_launch_remote_position_seconds %g\n",
+      position >= 0 ? (gdouble) position / GST_SECOND : 0.0);
+  METRIC (s, "duration_seconds", "gauge", "Duration of the current media");
+  g_string_append_printf (s, "gst_launch_remote_duration_seconds %g\n",
+      duration >= 0 ? (gdouble) duration / GST_SECOND : 0.0);
+  METRIC (s, "state", "gauge", "Current and target pipeline state "
+      "(0 pending, 1 null, 2 ready, 3 paused, 4 playing)");
+  g_string_append_printf (s, "gst_launch_remote_state{kind=\"current\"} %d\n"
+      "gst_launch_remote_state{kind=\"target\"} %d\n", state,
+      self->target_state);
+  METRIC (s, "buffering_percent", "gauge", "Last buffering level");
+  g_string_append_printf (s, "gst_launch_remote_buffering_percent %d\n",
+      g_atomic_int_get (&self->buffering_percent));
+  METRIC (s, "stalls_total", "counter", "Playback stalls without an error");
+  g_string_append_printf (s, "gst_launch_remote_stalls_total %u\n",
+      self->stall_count);
+  METRIC (s, "stall_seconds_total", "counter", "Time spent stalled");
+  g_string_append_printf (s, "gst_launch_remote_stall_seconds_total %g\n",
+      (gdouble) self->stall_total / GST_SECOND);
+  METRIC (s, "rebuffers_total", "counter", "Rebuffering events in this run");
+  g_string_append_printf (s, "gst_launch_remote_rebuffers_total %u\n",
+      self->rebuffer_count);
+  METRIC (s, "rebuffer_seconds_total", "counter",
+      "Time spent rebuffering in this run");
+  g_string_append_printf (s, "gst_launch_remote_rebuffer_seconds_total %g\n",
+      (gdouble) self->rebuffer_total / GST_SECOND);
+  METRIC (s, "playing_seconds", "gauge",
+      "Time since the last play, or duration of the last playback");
+  g_string_append_printf (s, "gst_launch_remote_playing_seconds %g\n",
+      playing);
+  METRIC (s, "last_seek_seconds", "gauge", "Latency of the last seek");
+  if (GST_CLOCK_TIME_IS_VALID (self->last_seek_async_done))
+    g_string_append_printf (s,
+        "gst_launch_remote_last_seek_seconds{until=\"async-done\"} %g\n",
+        (gdouble) self->last_seek_async_done / GST_SECOND);
+  if (GST_CLOCK_TIME_IS_VALID (self->last_seek_first_buffer))
+    g_string_append_printf (s,
+        "gst_launch_remote_last_seek_seconds{until=\"first-buffer\"} %g\n",
+        (gdouble) self->last_seek_first_buffer / GST_SECOND);
+
+  METRIC (s, "debug_records_total", "counter", "Debug log records");
+  g_string_append_printf (s,
+      "gst_launch_remote_debug_records_total{result=\"sent\"} %d\n"
+      "gst_launch_remote_debug_records_total{result=\"dropped\"} %d\n",
+      g_atomic_int_get (&debug_records_sent),
+      g_atomic_int_get (&debug_records_dropped));
+
+  METRIC (s, "bus_messages_total", "counter", "Bus messages by type");
+  for (i = 0; i < G_N_ELEMENTS (self->bus_message_counts); i++) {
+    gint count = g_atomic_int_get (&self->bus_message_counts[i]);
+
+    if (count > 0)
+      g_string_append_printf (s,
+          "gst_launch_remote_bus_messages_total{type=\"%s\"} %d\n",
+          gst_message_type_get_name (1U << i), count);
+  }
+  METRIC (s, "bus_message_seconds_total", "counter",
+      "Time spent handling bus messages by type");
+  for (i = 0; i < G_N_ELEMENTS (self->bus_message_time); i++) {
+    if (g_atomic_int_get (&self->bus_message_counts[i]) > 0)
+      g_string_append_printf (s,
+          "gst_launch_remote_bus_message_seconds_total{type=\"%s\"} %g\n",
+          gst_message_type_get_name (1U << i),
+          (gdouble) self->bus_message_time[i] / GST_SECOND);
+  }
+
+  METRIC (s, "qos_buffers_total", "counter",
+      "Buffers processed and dropped according to QoS messages");
+  g_hash_table_iter_init (&iter, self->qos_stats);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    QosStats *stats = value;
+    gchar *element = escape_label (key);
+
+    g_string_append_printf (s, "gst_launch_remote_qos_buffers_total"
+        "{element=\"%s\",result=\"processed\"} %" G_GUINT64_FORMAT "\n"
+        "gst_launch_remote_qos_buffers_total"
+        "{element=\"%s\",result=\"dropped\"} %" G_GUINT64_FORMAT "\n",
+        element, stats->processed, element, stats->dropped);
+    g_free (element);
+  }
+
+  append_histogram_metric (s, "gst_launch_remote_frame_interval_seconds",
+      "Inter-frame arrival interval at the video sink",
+      &self->pacing_intervals);
+  append_histogram_metric (s, "gst_launch_remote_frame_lateness_seconds",
+      "Lateness of frames at the video sink, early frames are in the "
+      "lowest bucket", &self->pacing_lateness);
+
+  return g_string_free (s, FALSE);
+}
+
+#undef METRIC
+
+typedef struct
+{
+  GstLaunchRemote *self;
+  GSocketConnection *connection;
+  GDataInputStream *distream;
+  gchar *path;
+  guint headers;
+  gchar *response;
+} MetricsRequest;
+
+static void
+metrics_request_free (MetricsRequest * req)
+{
+  g_object_unref (req->distream);
+  g_object_unref (req->connection);
+  g_free (req->path);
+  g_free (req->response);
+  g_slice_free (MetricsRequest, req);
+}
+
+static void
+metrics_write_cb (GObject * source_object, GAsyncResult * res,
+    gpointer user_data)
+{
+  MetricsRequest *req = user_data;
+  GError *err = NULL;
+
+  if (!g_output_stream_write_all_finish (G_OUTPUT_STREAM (source_object), res,
+          NULL, &err)) {
+    GST_WARNING ("Failed to send metrics: %s", err->message);
+    g_clear_error (&err);
+  }
+
+  g_io_stream_close (G_IO_STREAM (req->connection), NULL, NULL);
+  metrics_request_free (req);
+}
+
+static void
+metrics_respond (MetricsRequest * req)
+{
+  GOutputStream *ostream;
+
+  if (g_strcmp0 (req->path, "/metrics") == 0) {
+    gchar *body = build_metrics (req->self);
+
+    req->response = g_strdup_printf ("HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+        "Connection: close\r\n\r\n%s", strlen (body), body);
+    g_free (body);
+  } else {
+    req->response = g_strdup ("HTTP/1.0 404 Not Found\r\n"
+        "Content-Length: 0\r\nConnection: close\r\n\r\n");
+  }
+
+  ostream = g_io_stream_get_output_stream (G_IO_STREAM (req->connection));
+  g_output_stream_write_all_async (ostream, req->response,
+      strlen (req->response), G_PRIORITY_DEFAULT, NULL, metrics_write_cb, req);
+}
+
+static void metrics_read_line (MetricsRequest * req);
+
+static void
+metrics_fill_cb (GObject * source_object, GAsyncResult * res,
+    gpointer user_data)
+{
+  MetricsRequest *req = user_data;
+
+  if (g_buffered_input_stream_fill_finish (G_BUFFERED_INPUT_STREAM
+          (source_object), res, NULL) <= 0) {
+    metrics_request_free (req);
+    return;
+  }
+
+  metrics_read_line (req);
+}
+
+/* Reads the request line and skips all headers until the empty line. Lines
+ * are only taken from the stream's fixed size buffer, so a client that
+ * never sends a newline or sends endless headers is disconnected instead
+ * of growing it without limit */
+static void
+metrics_read_line (MetricsRequest * req)
+{
+  GBufferedInputStream *bstream = G_BUFFERED_INPUT_STREAM (req->distream);
+  const gchar *buffer;
+  const gchar *end;
+  gsize available;
+  gchar *line;
+
+  buffer = g_buffered_input_stream_peek_buffer (bstream, &available);
+  end = memchr (buffer, '\n', available);
+  if (!end) {
+    if (available >= METRICS_MAX_LINE_LENGTH) {
+      GST_WARNING ("Metrics request line too long");
+      metrics_request_free (req);
+      return;
+    }
+    g_buffered_input_stream_fill_async (bstream, -1, G_PRIORITY_DEFAULT,
+        NULL, metrics_fill_cb, req);
+    return;
+  }
+
+  line = g_strndup (buffer, end - buffer);
+  g_input_stream_skip (G_INPUT_STREAM (bstream), end - buffer + 1, NULL,
+      NULL);
+
+  line = g_strchomp (line);
+  if (!req->path) {
+    gchar **parts = g_strsplit (line, " ", 3);
+
+    if (parts[0] && parts[1] && strcmp (parts[0], "GET") == 0)
+      req->path = g_strdup (parts[1]);
+    else
+      req->path = g_strdup ("");
+    g_strfreev (parts);
+  } else if (line[0] == '\0') {
+    g_free (line);
+    metrics_respond (req);
+    return;
+  } else if (++req->headers > METRICS_MAX_HEADERS) {
+    GST_WARNING ("Too many headers in metrics request");
+    g_free (line);
+    metrics_request_free (req);
+    return;
+  }
+  g_free (line);
+
+  metrics_read_line (req);
+}
+
+static void
+metrics_incoming (GstLaunchRemote * self, GSocketConnection * connection)
+{
+  MetricsRequest *req = g_slice_new0 (MetricsRequest);
+  GInputStream *istream;
+
+  req->self = self;
+  req->connection = g_object_ref (connection);
+  istream = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+  req->distream = g_data_input_stream_new (istream);
+  g_buffered_input_stream_set_buffer_size (G_BUFFERED_INPUT_STREAM
+      (req->distream), METRICS_MAX_LINE_LENGTH);
+
+  metrics_read_line (req);
+}
+
+static gboolean
+metrics_enable (GstLaunchRemote * self, gint port)
+{
+  GSocketAddress *bind_addr;
+  GInetAddress *bind_iaddr;
+  GError *err = NULL;
+  gboolean ret;
+
+  if (!self->service || self->metrics_source)
+    return FALSE;
+
+  /* Connections on this port are told apart by the source object */
+  self->metrics_source = g_object_new (G_TYPE_OBJECT, NULL);
+
+  bind_iaddr = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+  bind_addr = g_inet_socket_address_new (bind_iaddr, port);
+  ret = g_socket_listener_add_address (G_SOCKET_LISTENER (self->service),
+      bind_addr, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP,
+      self->metrics_source, NULL, &err);
+  g_object_unref (bind_addr);
+  g_object_unref (bind_iaddr);
+
+  if (!ret) {
+    GST_ERROR ("ERROR: Can't add metrics port %d: %s", port, err->message);
+    g_clear_error (&err);
+    g_object_unref (self->metrics_source);
+    self->metrics_source = NULL;
+    return FALSE;
+  }
+
+  GST_DEBUG ("Serving metrics on port %d", port);
+
+  return TRUE;
+}
+
+typedef struct
+{
+  guint messages;
+  GstClockTime time;
+  GstClockTime max;
+} BusStats;
+
+static void
+bus_stats_free (BusStats * stats)
+{
+  g_slice_free (BusStats, stats);
+}
+
+static void
+bus_stats_add (GstLaunchRemote * self, GstMessage * msg, GstClockTime time)
+{
+  const gchar *name =
+      GST_MESSAGE_SRC (msg) ? GST_MESSAGE_SRC_NAME (msg) : "(none)";
+  guint type = message_type_index (msg);
+  BusStats *stats;
+
+  if (type < G_N_ELEMENTS (self->bus_message_time))
+    self->bus_message_time[type] += time;
+
+  stats = g_hash_table_lookup (self->bus_source_stats, name);
+  if (!stats) {
+    stats = g_slice_new0 (BusStats);
+    g_hash_table_insert (self->bus_source_stats, g_strdup (name), stats);
+  }
+  stats->messages++;
+  stats->time += time;
+  stats->max = MAX (stats->max, time);
+}
+
+/* Dispatches the messages directly instead of going through the detailed
+ * "message" signal emission of gst_bus_async_signal_func() */
+static gboolean
+bus_watch_cb (GstBus * bus, GstMessage * msg, GstLaunchRemote * self)
+{
+  GstClockTime start = gst_util_get_timestamp ();
+
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_ERROR:
+      error_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_EOS:
+      eos_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_STATE_CHANGED:
+      state_changed_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_BUFFERING:
+      buffering_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_CLOCK_LOST:
+      clock_lost_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_ASYNC_DONE:
+      async_done_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_QOS:
+      qos_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_DURATION_CHANGED:
+      duration_changed_cb (bus, msg, self);
+      break;
+    case GST_MESSAGE_SEGMENT_DONE:
+      segment_done_cb (bus, msg, self);
+      break;
+    default:
+      break;
+  }
+
+  bus_stats_add (self, msg, GST_CLOCK_DIFF (start, gst_util_get_timestamp ()));
+
+  return TRUE;
+}
+
+static void
+send_bus_stats (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  gchar *tmp;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (self->bus_message_counts); i++) {
+    gint count = g_atomic_int_get (&self->bus_message_counts[i]);
+
+    if (count > 0)
+      g_string_append_printf (s, "Type %s: messages=%d time=%.3fms\n",
+          gst_message_type_get_name (1U << i), count,
+          TIME_AS_MS (self->bus_message_time[i]));
+  }
+
+  g_hash_table_iter_init (&iter, self->bus_source_stats);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    BusStats *stats = value;
+
+    g_string_append_printf (s, "Source %s: messages=%u time=%.3fms "
+        "max=%.3fms\n", (const gchar *) key, stats->messages,
+        TIME_AS_MS (stats->time), TIME_AS_MS (stats->max));
+  }
+  if (s->len == 0)
+    g_string_append (s, "No bus messages\n");
+
+  tmp = g_string_free (s, FALSE);
+  write_to_remote (self, "%s", tmp);
+  g_free (tmp);
+}
+
+/* Loads the plugins of all element factories named in a pipeline
+ * description and initializes their classes, optionally also creating an
+ * instance of each, so that the real gst_parse_launch() does not pay for
+ * it. Elements that are only created later, e.g. by decodebin, are not
+ * covered */
+static guint
+prepare_pipeline (GstLaunchRemote * self, const gchar * description,
+    gboolean instantiate)
+{
+  GstClockTime start = gst_util_get_timestamp ();
+  GHashTable *seen = g_hash_table_new (g_str_hash, g_str_equal);
+  gchar **tokens = g_strsplit_set (description, " \t!", -1);
+  guint i, count = 0;
+
+  for (i = 0; tokens[i]; i++) {
+    GstPluginFeature *feature;
+    GstElementFactory *factory;
+
+    /* Skip properties, caps, element references and quoted values */
+    if (!g_ascii_isalpha (tokens[i][0]) || strpbrk (tokens[i], "=/.,\"'")
+        || g_hash_table_contains (seen, tokens[i]))
+      continue;
+    g_hash_table_add (seen, tokens[i]);
+
+    feature = GST_PLUGIN_FEATURE (gst_element_factory_find (tokens[i]));
+    if (!feature)
+      continue;
+
+    factory = GST_ELEMENT_FACTORY (gst_plugin_feature_load (feature));
+    gst_object_unref (feature);
+    if (!factory) {
+      GST_WARNING ("Failed to load %s", tokens[i]);
+      continue;
+    }
+
+    /* The class reference is kept, the class stays initialized */
+    g_type_class_ref (gst_element_factory_get_element_type (factory));
+    if (instantiate) {
+      GstElement *element = gst_element_factory_create (factory, NULL);
+
+      if (element)
+        gst_object_unref (gst_object_ref_sink (element));
+    }
+    gst_object_unref (factory);
+    count++;
+  }
+  g_strfreev (tokens);
+  g_hash_table_unref (seen);
+
+  self->prepared_factories += count;
+  self->prepare_time += GST_CLOCK_DIFF (start, gst_util_get_timestamp ());
+  GST_DEBUG ("Prepared %u factories of '%s' in %" GST_TIME_FORMAT, count,
+      description, GST_TIME_ARGS (GST_CLOCK_DIFF (start,
+              gst_util_get_timestamp ())));
+
+  return count;
+}
+
+#define TTFF_STEP(from, to) \
+  (GST_CLOCK_TIME_IS_VALID (from) && GST_CLOCK_TIME_IS_VALID (to) ? \
+      TIME_AS_MS (GST_CLOCK_DIFF (from, to)) : -1.0)
+
+/* Time to first frame of the current pipeline, each step relative to the
+ * previous one. -1 means the step did not happen (yet) */
+static void
+send_ttff (GstLaunchRemote * self)
+{
+  write_to_remote (self, "Parse %.3fms, preroll %.3fms, first buffer "
+      "%.3fms after creation, PLAYING %.3fms after play\n"
+      "%u factories prepared ahead in %.3fms\n",
+      TTFF_STEP (self->ttff_start, self->ttff_parsed),
+      TTFF_STEP (self->ttff_parsed, self->ttff_prerolled),
+      TTFF_STEP (self->ttff_start, self->ttff_first_buffer),
+      TTFF_STEP (self->last_play_time, self->ttff_playing),
+      self->prepared_factories, TIME_AS_MS (self->prepare_time));
+}
+
+/* Called from the streaming threads of the sinks */
+static GstPadProbeReturn
+stall_probe_cb (GstPad * pad, GstPadProbeInfo * info, GstLaunchRemote * self)
+{
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+    g_atomic_int_add (&self->stall_buffers,
+        gst_buffer_list_length (GST_PAD_PROBE_INFO_BUFFER_LIST (info)));
+  else
+    g_atomic_int_inc (&self->stall_buffers);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+stall_probe_install (const GValue * item, gpointer user_data)
+{
+  GstPad *pad = g_value_get_object (item);
+  gulong id;
+
+  if (!GST_PAD_IS_SINK (pad)
+      || g_object_get_qdata (G_OBJECT (pad), stall_probe_quark))
+    return;
+
+  id = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) stall_probe_cb, user_data, NULL);
+  g_object_set_qdata (G_OBJECT (pad), stall_probe_quark, GSIZE_TO_POINTER (id));
+}
+
+static void
+stall_probe_remove (const GValue * item, gpointer user_data)
+{
+  GstPad *pad = g_value_get_object (item);
+  gulong id;
+
+  id = GPOINTER_TO_SIZE (g_object_steal_qdata (G_OBJECT (pad),
+          stall_probe_quark));
+  if (id)
+    gst_pad_remove_probe (pad, id);
+}
+
+static void
+stall_probes_install_sink (const GValue * item, gpointer user_data)
+{
+  GstElement *sink = g_value_get_object (item);
+  GstIterator *it = gst_element_iterate_pads (sink);
+
+  while (gst_iterator_foreach (it, stall_probe_install,
+          user_data) == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+}
+
+static void
+stall_probes_remove_sink (const GValue * item, gpointer user_data)
+{
+  GstElement *sink = g_value_get_object (item);
+  GstIterator *it = gst_element_iterate_pads (sink);
+
+  while (gst_iterator_foreach (it, stall_probe_remove,
+          NULL) == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+}
+
+/* Counts the buffers arriving at all sinks for the watchdog. Unlike the
+ * +COUNTERS pad counters this is always done while the watchdog runs */
+static void
+stall_probes_set (GstLaunchRemote * self, gboolean install)
+{
+  GstIterator *it;
+
+  if (!self->pipeline || !GST_IS_BIN (self->pipeline))
+    return;
+
+  it = gst_bin_iterate_sinks (GST_BIN (self->pipeline));
+  while (gst_iterator_foreach (it, install ? stall_probes_install_sink :
+          stall_probes_remove_sink, self) == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+}
+
+static void
+stall_diagnostics_add (const GValue * item, gpointer user_data)
+{
+  GstElement *element = g_value_get_object (item);
+  gchar *stats = get_element_stats (element, ", ");
+
+  if (stats)
+    g_string_append_printf (user_data, "  %s: %s\n",
+        GST_OBJECT_NAME (element), stats);
+  g_free (stats);
+}
+
+static gchar *
+get_stall_diagnostics (GstLaunchRemote * self)
+{
+  GString *s = g_string_new (NULL);
+  GstIterator *it;
+
+  g_mutex_lock (&self->threads_lock);
+  g_string_append_printf (s, "  %u streaming threads started\n",
+      self->streaming_threads);
+  g_mutex_unlock (&self->threads_lock);
+
+  if (self->pipeline && GST_IS_BIN (self->pipeline)) {
+    it = gst_bin_iterate_recurse (GST_BIN (self->pipeline));
+    gst_iterator_foreach (it, stall_diagnostics_add, s);
+    gst_iterator_free (it);
+  }
+
+  return g_string_free (s, FALSE);
+}
+
+static void
+stall_end (GstLaunchRemote * self, GstClockTime now)
+{
+  GstClockTime duration;
+
+  if (!GST_CLOCK_TIME_IS_VALID (self->stall_start))
+    return;
+
+  duration = GST_CLOCK_DIFF (self->stall_start, now);
+  self->stall_total += duration;
+  self->stall_max = MAX (self->stall_max, duration);
+  self->stall_start = GST_CLOCK_TIME_NONE;
+  write_to_remote (self, "STALL: ended after %.3fms\n",
+      TIME_AS_MS (duration));
+}
+
+static void
+stall_begin (GstLaunchRemote * self, GstClockTime now)
+{
+  self->stall_start = self->stall_last_progress;
+  self->stall_count++;
+
+  g_free (self->stall_diagnostics);
+  self->stall_diagnostics = get_stall_diagnostics (self);
+
+  set_message (self, "Stalled at %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (MAX (self->stall_last_position, 0)));
+  autodump_capture (self, self->last_message);
+  write_to_remote (self, "STALL: no progress for %.3fms at %"
+      GST_TIME_FORMAT "\n%s", TIME_AS_MS (GST_CLOCK_DIFF (self->stall_start,
+              now)), GST_TIME_ARGS (MAX (self->stall_last_position, 0)),
+      self->stall_diagnostics);
+
+  if (self->stall_restart && self->pipeline_string) {
+    gchar *pipeline_string = g_strdup (self->pipeline_string);
+
+    stall_end (self, now);
+    self->stall_restarts++;
+    gst_launch_remote_set_pipeline (self, pipeline_string);
+    play_pipeline (self);
+    g_free (pipeline_string);
+  }
+}
+
+/* Progress means buffers arriving at the sinks or the position moving.
+ * Only checked while the pipeline is supposed to and does play, not
+ * while it is prerolling or buffering */
+static gboolean
+stall_check_cb (GstLaunchRemote * self)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+  gint64 buffers, position = -1;
+
+  if (!self->pipeline || self->target_state < GST_STATE_PLAYING
+      || GST_STATE (self->pipeline) != GST_STATE_PLAYING
+      || self->buffering_paused) {
+    stall_end (self, now);
+    self->stall_last_progress = now;
+    return G_SOURCE_CONTINUE;
+  }
+
+  buffers = g_atomic_int_get (&self->stall_buffers);
+  gst_element_query_position (self->pipeline, GST_FORMAT_TIME, &position);
+
+  if (buffers != self->stall_last_buffers
+      || position != self->stall_last_position) {
+    self->stall_last_buffers = buffers;
+    self->stall_last_position = position;
+    self->stall_last_progress = now;
+    stall_end (self, now);
+  } else if (!GST_CLOCK_TIME_IS_VALID (self->stall_start)
+      && GST_CLOCK_DIFF (self->stall_last_progress, now) >=
+      (GstClockTimeDiff) self->stall_timeout * GST_MSECOND) {
+    stall_begin (self, now);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+stall_watchdog_set (GstLaunchRemote * self, guint timeout, gboolean restart)
+{
+  if (self->stall_source) {
+    g_source_destroy (self->stall_source);
+    g_source_unref (self->stall_source);
+    self->stall_source = NULL;
+  }
+
+  self->stall_timeout = timeout;
+  self->stall_restart = restart;
+  self->stall_last_progress = gst_util_get_timestamp ();
+  self->stall_start = GST_CLOCK_TIME_NONE;
+  stall_probes_set (self, timeout != 0);
+  if (timeout == 0)
+    return;
+
+  self->stall_source = g_timeout_source_new (CLAMP (timeout / 4, 10, 1000));
+  g_source_set_callback (self->stall_source, (GSourceFunc) stall_check_cb,
+      self, NULL);
+  g_source_attach (self->stall_source, self->context);
+}
+
+static void
+send_stall_stats (GstLaunchRemote * self)
+{
+  write_to_remote (self, "Watchdog %s (%ums%s), %u stalls, %u restarts, "
+      "total %.3fms, max %.3fms\n%s",
+      self->stall_timeout ? "enabled" : "disabled", self->stall_timeout,
+      self->stall_restart ? ", restart" : "", self->stall_count,
+      self->stall_restarts, TIME_AS_MS (self->stall_total),
+      TIME_AS_MS (self->stall_max), self->stall_diagnostics ?
+      self->stall_diagnostics : "");
+}
+
+/* Session files have one received command per line, prefixed with its
+ * arrival time in nanoseconds since the recording started */
+static void
+record_stop (GstLaunchRemote * self)
+{
+  if (!self->record_stream)
+    return;
+
+  g_output_stream_close (self->record_stream, NULL, NULL);
+  g_object_unref (self->record_stream);
+  self->record_stream = NULL;
+}
+
+static gboolean
+record_start (GstLaunchRemote * self, const gchar * path)
+{
+  GFile *file = g_file_new_for_path (path);
+  GFileOutputStream *stream;
+  GError *err = NULL;
+
+  stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &err);
+  g_object_unref (file);
+  if (!stream) {
+    write_to_remote (self, "Can't record to %s: %s\n", path, err->message);
+    g_clear_error (&err);
+    return FALSE;
+  }
+
+  record_stop (self);
+  self->record_stream = G_OUTPUT_STREAM (stream);
+  self->record_start = gst_util_get_timestamp ();
+
+  return TRUE;
+}
+
+static void
+record_command (GstLaunchRemote * self, const gchar * line)
+{
+  gchar *entry;
+
+  if (!self->record_stream || g_str_has_prefix (line, "+RECORD")
+      || g_str_has_prefix (line, "-RECORD"))
+    return;
+
+  entry = g_strdup_printf ("%" G_GUINT64_FORMAT " %s\n",
+      (guint64) GST_CLOCK_DIFF (self->record_start,
+          gst_util_get_timestamp ()), line);
+  if (!g_output_stream_write_all (self->record_stream, entry, strlen (entry),
+          NULL, NULL, NULL)) {
+    GST_ERROR ("Failed to record command, stopping recording");
+    record_stop (self);
+  }
+  g_free (entry);
+}
+
+typedef struct
+{
+  GstClockTime time;
+  gchar *line;
+} ReplayEntry;
+
+static void
+replay_entry_free (ReplayEntry * entry)
+{
+  g_free (entry->line);
+  g_slice_free (ReplayEntry, entry);
+}
+
+static void
+replay_stop (GstLaunchRemote * self)
+{
+  if (self->replay_source) {
+    g_source_destroy (self->replay_source);
+    g_source_unref (self->replay_source);
+    self->replay_source = NULL;
+  }
+  if (self->replay) {
+    g_ptr_array_unref (self->replay);
+    self->replay = NULL;
+  }
+}
+
+static void
+replay_finish (GstLaunchRemote * self, const gchar * result)
+{
+  write_to_remote (self, "REPLAY: %s, %u of %u commands in %.3fms, "
+      "%u failed, max lateness %.3fms\n", result, self->replay_index,
+      self->replay->len, TIME_AS_MS (GST_CLOCK_DIFF (self->replay_start,
+              gst_util_get_timestamp ())), self->replay_failed,
+      TIME_AS_MS (self->replay_max_lateness));
+  replay_stop (self);
+}
+
+static gboolean replay_next_cb (GstLaunchRemote * self);
+
+static void
+replay_schedule (GstLaunchRemote * self)
+{
+  ReplayEntry *entry;
+  GstClockTimeDiff delay = 0;
+
+  if (self->replay_index >= self->replay->len) {
+    replay_finish (self, "finished");
+    return;
+  }
+
+  entry = g_ptr_array_index (self->replay, self->replay_index);
+  if (!self->replay_fast)
+    delay = GST_CLOCK_DIFF (gst_util_get_timestamp (),
+        self->replay_start + entry->time);
+
+  self->replay_source = g_timeout_source_new (MAX (delay, 0) / GST_MSECOND);
+  g_source_set_callback (self->replay_source, (GSourceFunc) replay_next_cb,
+      self, NULL);
+  g_source_attach (self->replay_source, self->context);
+}
+
+/* Runs all commands that are due and schedules the next one */
+static gboolean
+replay_next_cb (GstLaunchRemote * self)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  g_source_unref (self->replay_source);
+  self->replay_source = NULL;
+
+  while (self->replay && self->replay_index < self->replay->len) {
+    ReplayEntry *entry = g_ptr_array_index (self->replay, self->replay_index);
+    gchar *line;
+
+    if (!self->replay_fast) {
+      if (self->replay_start + entry->time > now)
+        break;
+      self->replay_max_lateness = MAX (self->replay_max_lateness,
+          now - (self->replay_start + entry->time));
+    }
+
+    line = g_strdup (entry->line);
+    self->replay_index++;
+    if (!handle_command (self, line))
+      self->replay_failed++;
+    g_free (line);
+
+    /* Give the main loop a chance to process the results */
+    if (self->replay_fast)
+      break;
+  }
+
+  if (self->replay)
+    replay_schedule (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+replay_start (GstLaunchRemote * self, const gchar * path, gboolean fast)
+{
+  gchar *contents;
+  gchar **lines;
+  GError *err = NULL;
+  GPtrArray *replay;
+  guint i;
+
+  if (!g_file_get_contents (path, &contents, NULL, &err)) {
+    write_to_remote (self, "Can't replay %s: %s\n", path, err->message);
+    g_clear_error (&err);
+    return FALSE;
+  }
+
+  replay = g_ptr_array_new_with_free_func ((GDestroyNotify) replay_entry_free);
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+  for (i = 0; lines[i]; i++) {
+    gchar *command = NULL;
+    guint64 time = g_ascii_strtoull (lines[i], &command, 10);
+    ReplayEntry *entry;
+
+    if (command == lines[i] || *command != ' '
+        || g_str_has_prefix (command + 1, "+REPLAY")
+        || g_str_has_prefix (command + 1, "-REPLAY"))
+      continue;
+
+    entry = g_slice_new (ReplayEntry);
+    entry->time = time;
+    entry->line = g_strdup (command + 1);
+    g_ptr_array_add (replay, entry);
+  }
+  g_strfreev (lines);
+
+  replay_stop (self);
+  self->replay = replay;
+  self->replay_index = 0;
+  self->replay_fast = fast;
+  self->replay_failed = 0;
+  self->replay_max_lateness = 0;
+  self->replay_start = gst_util_get_timestamp ();
+  replay_schedule (self);
+
+  return TRUE;
+}
+
+/* Looks up "element.property" in the running pipeline. The element name
+ * may contain dots, the property name can't */
+static GstElement *
+get_element_property (GstLaunchRemote * self, const gchar * name,
+    GParamSpec ** pspec)
+{
+  const gchar *dot = strrchr (name, '.');
+  GstElement *element = NULL;
+  gchar *element_name;
+
+  if (!self->pipeline) {
+    write_to_remote (self, "No pipeline\n");
+    return NULL;
+  }
+  if (!dot || dot == name || dot[1] == '\0') {
+    write_to_remote (self, "Expected element.property, got '%s'\n", name);
+    return NULL;
+  }
+
+  element_name = g_strndup (name, dot - name);
+  if (g_str_equal (element_name, GST_OBJECT_NAME (self->pipeline)))
+    element = gst_object_ref (self->pipeline);
+  else if (GST_IS_BIN (self->pipeline))
+    element = gst_bin_get_by_name (GST_BIN (self->pipeline), element_name);
+
+  if (!element) {
+    write_to_remote (self, "No element '%s'\n", element_name);
+  } else {
+    *pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+        dot + 1);
+    if (!*pspec) {
+      write_to_remote (self, "Element '%s' has no property '%s'\n",
+          element_name, dot + 1);
+      gst_object_unref (element);
+      element = NULL;
+    }
+  }
+  g_free (element_name);
+
+  return element;
+}
+
+static gboolean
+get_property (GstLaunchRemote * self, const gchar * name)
+{
+  GValue value = G_VALUE_INIT;
+  GParamSpec *pspec = NULL;
+  GstElement *element;
+  gchar *str;
+
+  element = get_element_property (self, name, &pspec);
+  if (!element)
+    return FALSE;
+
+  if (!(pspec->flags & G_PARAM_READABLE)) {
+    write_to_remote (self, "Property '%s' is not readable\n", name);
+    gst_object_unref (element);
+    return FALSE;
+  }
+
+  g_value_init (&value, pspec->value_type);
+  g_object_get_property (G_OBJECT (element), pspec->name, &value);
+  str = gst_value_serialize (&value);
+  if (!str)
+    str = g_strdup_value_contents (&value);
+  write_to_remote (self, "GET: %s=%s\n", name, str);
+  g_free (str);
+  g_value_unset (&value);
+  gst_object_unref (element);
+
+  return TRUE;
+}
+
+/* Uses the same string conversion as gst-launch lines */
+static gboolean
+set_property (GstLaunchRemote * self, const gchar * name, const gchar * str)
+{
+  GValue value = G_VALUE_INIT;
+  GParamSpec *pspec = NULL;
+  GstElement *element;
+  GstState state;
+  gboolean ok = FALSE;
+
+  element = get_element_property (self, name, &pspec);
+  if (!element)
+    return FALSE;
+
+  state = GST_STATE (element);
+  g_value_init (&value, pspec->value_type);
+  if (!(pspec->flags & G_PARAM_WRITABLE)
+      || (pspec->flags & G_PARAM_CONSTRUCT_ONLY)) {
+    write_to_remote (self, "Property '%s' is not writable\n", name);
+  } else if (!gst_value_deserialize (&value, str)) {
+    write_to_remote (self, "Can't convert '%s' to %s\n", str,
+        g_type_name (pspec->value_type));
+  } else {
+    g_object_set_property (G_OBJECT (element), pspec->name, &value);
+    ok = TRUE;
+
+    if (((pspec->flags & GST_PARAM_MUTABLE_READY) && state > GST_STATE_READY)
+        || ((pspec->flags & GST_PARAM_MUTABLE_PAUSED)
+            && state > GST_STATE_PAUSED))
+      write_to_remote (self, "SET: %s=%s, may only apply after a restart in "
+          "%s\n", name, str, gst_element_state_get_name (state));
+    else
+      write_to_remote (self, "SET: %s=%s\n", name, str);
+  }
+  g_value_unset (&value);
+  gst_object_unref (element);
+
+  return ok;
+}
+
+static gboolean
+query_latency (GstPad * pad, gboolean peer, GstClockTime * min,
+    GstClockTime * max)
+{
+  GstQuery *query = gst_query_new_latency ();
+  gboolean live = FALSE, ret;
+
+  ret = peer ? gst_pad_peer_query (pad, query) : gst_pad_query (pad, query);
+  if (ret)
+    gst_query_parse_latency (query, &live, min, max);
+  gst_query_unref (query);
+
+  return ret && live;
+}
+
+typedef struct
+{
+  GstClockTime min, max;
+  gboolean live;
+} LatencyRange;
+
+static void
+latency_add_pad (const GValue * item, gpointer user_data)
+{
+  GstPad *pad = g_value_get_object (item);
+  LatencyRange *range = user_data;
+  GstClockTime min = 0, max = GST_CLOCK_TIME_NONE;
+
+  /* Sink pads report what arrives from upstream, src pads what leaves */
+  if (!query_latency (pad, GST_PAD_IS_SINK (pad), &min, &max))
+    return;
+
+  range->live = TRUE;
+  range->min = MAX (range->min, min);
+  if (GST_CLOCK_TIME_IS_VALID (max))
+    range->max = MIN (range->max, max);
+}
+
+/* Latency an element adds on top of its upstream, the difference of the
+ * minimum latency leaving and entering it */
+static void
+latency_add_element (const GValue * item, gpointer user_data)
+{
+  GstElement *element = g_value_get_object (item);
+  LatencyRange in = { 0, GST_CLOCK_TIME_NONE, FALSE };
+  LatencyRange out = { 0, GST_CLOCK_TIME_NONE, FALSE };
+  GstIterator *it;
+
+  if (GST_IS_BIN (element))
+    return;
+
+  it = gst_element_iterate_sink_pads (element);
+  gst_iterator_foreach (it, latency_add_pad, &in);
+  gst_iterator_free (it);
+  it = gst_element_iterate_src_pads (element);
+  gst_iterator_foreach (it, latency_add_pad, &out);
+  gst_iterator_free (it);
+
+  if (out.live && out.min > in.min)
+    g_string_append_printf (user_data, "LATENCY:   %s: +%.3fms\n",
+        GST_OBJECT_NAME (element), TIME_AS_MS (out.min - in.min));
+  else if (!out.live && in.live)
+    g_string_append_printf (user_data, "LATENCY:   %s: %.3fms arriving\n",
+        GST_OBJECT_NAME (element), TIME_AS_MS (in.min));
+}
+
+static gboolean
+send_latency (GstLaunchRemote * self)
+{
+  GstQuery *query;
+  GstIterator *it;
+  GString *s;
+  gboolean live = FALSE;
+  GstClockTime min = 0, max = GST_CLOCK_TIME_NONE, configured;
+
+  if (!self->pipeline) {
+    write_to_remote (self, "No pipeline\n");
+    return FALSE;
+  }
+
+  query = gst_query_new_latency ();
+  if (!gst_element_query (self->pipeline, query)) {
+    gst_query_unref (query);
+    write_to_remote (self, "LATENCY: query failed\n");
+    return FALSE;
+  }
+  gst_query_parse_latency (query, &live, &min, &max);
+  gst_query_unref (query);
+
+  s = g_string_new (NULL);
+  g_string_append_printf (s, "LATENCY: %s, min %.3fms, ",
+      live ? "live" : "not live", TIME_AS_MS (min));
+  if (GST_CLOCK_TIME_IS_VALID (max))
+    g_string_append_printf (s, "max %.3fms", TIME_AS_MS (max));
+  else
+    g_string_append (s, "max unlimited");
+
+  configured = GST_IS_PIPELINE (self->pipeline) ?
+      gst_pipeline_get_latency (GST_PIPELINE (self->pipeline)) :
+      GST_CLOCK_TIME_NONE;
+  if (GST_CLOCK_TIME_IS_VALID (configured))
+    g_string_append_printf (s, ", configured %.3fms\n",
+        TIME_AS_MS (configured));
+  else
+    g_string_append (s, ", configured automatically\n");
+
+  if (live && GST_IS_BIN (self->pipeline)) {
+    it = gst_bin_iterate_recurse (GST_BIN (self->pipeline));
+    gst_iterator_foreach (it, latency_add_element, s);
+    gst_iterator_free (it);
+  }
+
+  write_to_remote (self, "%s", s->str);
+  g_string_free (s, TRUE);
+
+  return TRUE;
+}
+
+/* Runs a single command. The line may be modified */
+static gboolean
+handle_command (GstLaunchRemote * self, gchar * line)
+{
+  gboolean ok = TRUE;
+
+  if (g_str_has_prefix (line, "+DEBUGFILE ")) {
+    gchar **args = g_strsplit (line + sizeof ("+DEBUGFILE"), " ", 3);
+    gchar *endptr = NULL;
+    guint64 size = 0;
+
+    if (g_strv_length (args) >= 2)
+      size = g_ascii_strtoull (args[1], &endptr, 10);
+
+    if (size == 0 || *endptr != '\0' || size > G_MAXSIZE / 2) {
+      write_to_remote (self, "Log into a circular memory-mapped file. "
+          "Usage: +DEBUGFILE path size-in-bytes [debug config]\n");
+      ok = FALSE;
+    } else {
+      gchar *error = NULL;
+
+      if (debug_file_open (args[0], size, &error)) {
+        gst_debug_set_active (TRUE);
+        if (args[2] && args[2][0])
+          gst_debug_set_threshold_from_string (args[2], TRUE);
+        else
+          gst_debug_set_default_threshold (GST_LEVEL_DEBUG);
+      } else {
+        write_to_remote (self, "%s\n", error);
+        g_free (error);
+        ok = FALSE;
+      }
+    }
+    g_strfreev (args);
+  } else if (g_str_has_prefix (line, "+DEBUGFILE")) {
+    gchar *path = NULL;
+    guint64 written = 0, size = 0;
+
+    /* Don't write to the remote with the lock, it might log */
+    G_LOCK (debug_file);
+    if (debug_file) {
+      path = g_strdup (debug_file_path);
+      written = debug_file->write_pos;
+      size = debug_file->size;
+    }
+    G_UNLOCK (debug_file);
+
+    if (path)
+      write_to_remote (self, "Logging to %s: %" G_GUINT64_FORMAT
+          " bytes written into %" G_GUINT64_FORMAT " bytes%s\n", path,
+          written, size, written > size ? ", wrapped" : "");
+    else
+      write_to_remote (self, "No debug file\n");
+    g_free (path);
+  } else if (g_str_has_prefix (line, "-DEBUGFILE")) {
+    gboolean sockets_active = FALSE;
+    GList *l;
+
+    debug_file_close ();
+    G_LOCK (debug_sockets);
+    for (l = debug_sockets; l; l = l->next)
+      sockets_active |= ((DebugSocket *) l->data)->address != NULL;
+    G_UNLOCK (debug_sockets);
+    gst_debug_set_active (sockets_active);
+  } else if (g_str_has_prefix (line, "+DEBUG ")) {
+    gchar *address = line + sizeof ("+DEBUG ") - 1;
+    gchar *colon = strchr (address, ':');
+    gchar *cats_str;
+
+    ok = FALSE;
+    if (colon) {
+      gint port = strtol (colon + 1, &cats_str, 10);
+
+      if (port > 0) {
+        GSocketAddress *addr;
+        *colon = '\0';
+
+        addr = g_inet_socket_address_new_from_string (address, port);
+        if (addr) {
+          GList *l;
+
+          G_LOCK (debug_sockets);
+          for (l = debug_sockets; l; l = l->next) {
+            DebugSocket *s = l->data;
+
+            if (s->socket == self->debug_socket) {
+              ok = TRUE;
+              s->address = addr;
+              gst_debug_set_active (TRUE);
+              break;
+            }
+          }
+          if (cats_str && cats_str[0])
+            gst_debug_set_threshold_from_string (cats_str, TRUE);
+          else
+            gst_debug_set_default_threshold (GST_LEVEL_DEBUG);
+          G_UNLOCK (debug_sockets);
+        }
+      }
+    } else {
+      write_to_remote (self, "Usage: +DEBUG host-or-IP:port [debug config]");
+    }
+  } else if (g_str_has_prefix (line, "-DEBUG")) {
+    GList *l;
+    gboolean all_disabled = TRUE;
+
+    G_LOCK (debug_sockets);
+    for (l = debug_sockets; l; l = l->next) {
+      DebugSocket *s = l->data;
+
+      if (s->socket == self->debug_socket) {
+        if (s->address)
+          g_object_unref (s->address);
+        s->address = NULL;
+      }
+
+      all_disabled &= s->address == NULL;
+    }
+    G_UNLOCK (debug_sockets);
+    all_disabled &= !debug_file_active ();
+    gst_debug_set_active (!all_disabled);
+    if (!all_disabled)
+      gst_debug_set_default_threshold (GST_LEVEL_DEBUG);
+  } else if (g_str_has_prefix (line, "+PLAYAT ")) {
+    gchar *endptr = NULL;
+    guint64 time = g_ascii_strtoull (line + sizeof ("+PLAYAT"), &endptr, 10);
+
+    if (*endptr != '\0' || !GST_CLOCK_TIME_IS_VALID (time)) {
+      write_to_remote (self, "Preroll now and go to PLAYING at the given "
+          "clock time. Usage: +PLAYAT nanoseconds\n");
+      ok = FALSE;
+    } else {
+      ok = playat_start (self, time);
+    }
+  } else if (g_str_has_prefix (line, "+PLAY")) {
+    play_pipeline (self);
+  } else if (g_str_has_prefix (line, "+PAUSE")) {
+    pause_pipeline (self);
+  } else if (g_str_has_prefix (line, "+SEEK ")) {
+    gchar *position = line + sizeof ("+SEEK ") - 1;
+    gchar *endptr = NULL;
+    guint64 ms = g_ascii_strtoull (position, &endptr, 10);
+
+    if (*endptr == '\0') {
+      gst_launch_remote_seek (self, ms);
+    } else {
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+SEEKMODE ")) {
+    gchar *mode = line + sizeof ("+SEEKMODE ") - 1;
+
+    if (strcmp (mode, "default") == 0) {
+      self->seek_flags = 0;
+    } else if (strcmp (mode, "key-unit") == 0) {
+      self->seek_flags = GST_SEEK_FLAG_KEY_UNIT;
+    } else if (strcmp (mode, "accurate") == 0) {
+      self->seek_flags = GST_SEEK_FLAG_ACCURATE;
+    } else if (strcmp (mode, "snap-before") == 0) {
+      self->seek_flags = GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE;
+    } else if (strcmp (mode, "snap-after") == 0) {
+      self->seek_flags = GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_AFTER;
+    } else {
+      write_to_remote (self, "Usage: +SEEKMODE "
+          "default|key-unit|accurate|snap-before|snap-after\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+SEEKBENCH")) {
+    gchar **args = g_strsplit (line + sizeof ("+SEEKBENCH") - 1, " ", -1);
+    guint64 count = 0;
+    gboolean random = TRUE;
+    gchar **arg;
+
+    ok = TRUE;
+    for (arg = args; *arg; arg++) {
+      if (**arg == '\0')
+        continue;
+      else if (strcmp (*arg, "random") == 0)
+        random = TRUE;
+      else if (strcmp (*arg, "sequential") == 0)
+        random = FALSE;
+      else if (count == 0) {
+        gchar *endptr = NULL;
+
+        count = g_ascii_strtoull (*arg, &endptr, 10);
+        if (*endptr != '\0' || count > G_MAXUINT)
+          ok = FALSE;
+      } else {
+        ok = FALSE;
+      }
+    }
+    g_strfreev (args);
+
+    if (!ok || count == 0) {
+      write_to_remote (self,
+          "Usage: +SEEKBENCH count [random|sequential]\n");
+      ok = FALSE;
+    } else {
+      ok = seek_bench_start (self, count, random);
+    }
+  } else if (g_str_has_prefix (line, "+NETCLOCKSTAT")) {
+    send_net_clock_stats (self);
+  } else if (g_str_has_prefix (line, "+SYNCWAIT ")) {
+    gchar *endptr = NULL;
+    guint64 timeout =
+        g_ascii_strtoull (line + sizeof ("+SYNCWAIT"), &endptr, 10);
+
+    if (*endptr != '\0' || timeout > G_MAXUINT) {
+      write_to_remote (self, "Wait up to the given time for the net clock "
+          "to sync before +PLAY, 0 disables. Usage: +SYNCWAIT ms\n");
+      ok = FALSE;
+    } else {
+      self->sync_timeout = timeout;
+    }
+  } else if (g_str_has_prefix (line, "+NETCLOCKSERVE ")) {
+    gchar *endptr = NULL;
+    glong port = strtol (line + sizeof ("+NETCLOCKSERVE ") - 1, &endptr, 10);
+
+    if (*endptr == '\0' && port > 0 && port <= 65535) {
+      ok = time_provider_start (self, port);
+    } else {
+      write_to_remote (self, "Provide the pipeline clock as network clock. "
+          "Usage: +NETCLOCKSERVE port\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "-NETCLOCKSERVE")) {
+    clock_test_stop (self);
+    time_provider_stop (self);
+    if (self->pipeline && !self->net_clock)
+      gst_pipeline_auto_clock (GST_PIPELINE (self->pipeline));
+  } else if (g_str_has_prefix (line, "+NETCLOCKTEST")) {
+    gchar *endptr = NULL;
+    guint64 count =
+        g_ascii_strtoull (line + sizeof ("+NETCLOCKTEST") - 1, &endptr, 10);
+    guint64 timeout = 5000;
+
+    if (*endptr == ' ')
+      timeout = g_ascii_strtoull (endptr, &endptr, 10);
+
+    if (*endptr != '\0' || count == 0 || count > 64 || timeout > G_MAXUINT) {
+      write_to_remote (self, "Sync clients to +NETCLOCKSERVE over loopback. "
+          "Usage: +NETCLOCKTEST count [timeout-ms]\n");
+      ok = FALSE;
+    } else {
+      ok = clock_test_start (self, count, timeout);
+    }
+  } else if (g_str_has_prefix (line, "+NETCLOCK ")) {
+    gchar **command;
+
+    if (*(line + sizeof ("+NETCLOCK") - 1) == '\0')
+      command = g_new0 (gchar *, 1);
+    else
+      command = g_strsplit (line + sizeof ("+NETCLOCK"), " ", 2);
+
+    /* A pending +PLAY does not wait for the old clock anymore */
+    if (self->sync_wait_source) {
+      sync_wait_stop (self);
+      set_playing (self);
+    }
+    net_clock_clear (self);
+    if (command[0] && command[1]) {
+      gint64 port = g_ascii_strtoll (command[1], NULL, 10);
+      net_clock_set (self, command[0], port);
+    } else {
+      GST_DEBUG ("Unsetting netclock");
+    }
 
-  g_free (tmp);
+    /* Serve the new clock, the test clients synced to the old one */
+    if (self->time_provider) {
+      gint port = self->provided_port;
+
+      clock_test_stop (self);
+      ok = time_provider_start (self, port);
+    }
+
+    g_strfreev (command);
+  } else if (g_str_has_prefix (line, "+BASETIME ")) {
+    gchar *endptr = NULL;
+    guint64 base_time =
+        g_ascii_strtoull (line + sizeof ("+BASETIME"), &endptr, 10);
+
+    if (*endptr != '\0') {
+      ok = FALSE;
+      self->base_time = GST_CLOCK_TIME_NONE;
+    } else {
+      self->base_time = base_time;
+      GST_DEBUG ("Setting base time %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (base_time));
+      if (self->pipeline) {
+        gst_element_set_base_time (self->pipeline, base_time);
+        gst_element_set_start_time (self->pipeline, GST_CLOCK_TIME_NONE);
+      }
+    }
+  } else if (g_str_has_prefix (line, "+STAT")) {
+    GstClockTime position = -1, duration = -1;
+    gchar *tmp;
+    GstState s = GST_STATE_VOID_PENDING;
+
+    if (self->pipeline) {
+      gst_element_query_duration (self->pipeline, GST_FORMAT_TIME, &duration);
+      gst_element_query_position (self->pipeline, GST_FORMAT_TIME, &position);
+      s = GST_STATE (self->pipeline);
+    }
+
+    tmp =
+        g_strdup_printf ("%" GST_TIME_FORMAT " / %" GST_TIME_FORMAT
+        " @ %s\nLast message: %s\nLast seek: %" GST_TIME_FORMAT
+        " (ASYNC_DONE), %" GST_TIME_FORMAT " (first buffer)\n"
+        "Stalls: %u, %" GST_TIME_FORMAT " total\n",
+        GST_TIME_ARGS (position), GST_TIME_ARGS (duration),
+        gst_element_state_get_name (s), GST_STR_NULL (self->last_message),
+        GST_TIME_ARGS (self->last_seek_async_done),
+        GST_TIME_ARGS (self->last_seek_first_buffer), self->stall_count,
+        GST_TIME_ARGS (self->stall_total));
+    write_to_remote (self, "%s", tmp);
+    g_free (tmp);
+  } else if (g_str_has_prefix (line, "+DUMP ")) {
+    gchar *address = line + sizeof ("+DUMP ") - 1;
+    gchar *colon = strchr (address, ':');
+    gchar *options = NULL;
+
+    ok = FALSE;
+    if (colon) {
+      gint port = strtol (colon + 1, &options, 10);
+
+      if (port > 0 && (*options == '\0' || strcmp (options, " gzip") == 0)) {
+        *colon = '\0';
+        ok = send_pipeline_dump (self, address, port, *options != '\0');
+      }
+    } else {
+      write_to_remote (self,
+          "Send a pipeline .dot dump to a remote port. Usage: +DUMP host-or-IP:port [gzip]\n");
+    }
+  } else if (g_str_has_prefix (line, "+COUNTERS ")) {
+    const gchar *arg = line + sizeof ("+COUNTERS");
+
+    if (g_str_equal (arg, "on") || g_str_equal (arg, "off")) {
+      self->pad_counters = g_str_equal (arg, "on");
+      if (self->pipeline && GST_IS_BIN (self->pipeline)) {
+        if (self->pad_counters)
+          pad_counters_install (self->pipeline);
+        else
+          pad_counters_remove (self->pipeline);
+      }
+    } else {
+      write_to_remote (self, "Count buffers and bytes on all pads for "
+          "+DUMP and +STALL. Usage: +COUNTERS on|off\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+SNAPSHOT ")) {
+    gchar *address = line + sizeof ("+SNAPSHOT ") - 1;
+    gchar *colon = strchr (address, ':');
+    gchar *format = NULL;
+
+    ok = FALSE;
+    if (colon) {
+      gint port = strtol (colon + 1, &format, 10);
+
+      if (port > 0 && (*format == '\0' || strcmp (format, " png") == 0
+              || strcmp (format, " raw") == 0)) {
+        *colon = '\0';
+        ok = send_snapshot (self, address, port,
+            strcmp (format, " raw") != 0);
+      }
+    } else {
+      write_to_remote (self, "Send the last rendered frame to a remote port. "
+          "Usage: +SNAPSHOT host-or-IP:port [png|raw]\n");
+    }
+  } else if (g_str_has_prefix (line, "+METRICS ")) {
+    gchar *endptr = NULL;
+    glong port = strtol (line + sizeof ("+METRICS ") - 1, &endptr, 10);
+
+    if (*endptr == '\0' && port > 0 && port <= 65535) {
+      ok = metrics_enable (self, port);
+    } else {
+      write_to_remote (self, "Serve Prometheus metrics over HTTP. "
+          "Usage: +METRICS port\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+POSINTERVAL ")) {
+    gchar *endptr = NULL;
+    guint64 interval =
+        g_ascii_strtoull (line + sizeof ("+POSINTERVAL"), &endptr, 10);
+
+    if (*endptr != '\0' || interval > G_MAXUINT) {
+      write_to_remote (self, "Set the position reporting interval while "
+          "playing, 0 disables it. Usage: +POSINTERVAL ms\n");
+      ok = FALSE;
+    } else {
+      gboolean running = self->position_source != NULL;
+
+      self->position_interval = interval;
+      position_timer_stop (self);
+      if (running || (self->pipeline
+              && GST_STATE (self->pipeline) == GST_STATE_PLAYING))
+        position_timer_start (self);
+    }
+  } else if (g_str_has_prefix (line, "+BUFFERING")) {
+    gchar **args = g_strsplit (line + sizeof ("+BUFFERING") - 1, " ", -1);
+    guint argc = g_strv_length (args);
+
+    if (argc == 3 && args[0][0] == '\0' && g_ascii_isdigit (args[1][0])
+        && g_ascii_isdigit (args[2][0])) {
+      gchar *low_end = NULL, *high_end = NULL;
+      guint64 low = g_ascii_strtoull (args[1], &low_end, 10);
+      guint64 high = g_ascii_strtoull (args[2], &high_end, 10);
+
+      if (*low_end == '\0' && *high_end == '\0' && low <= high
+          && high <= 100) {
+        self->buffering_low = low;
+        self->buffering_high = high;
+      } else {
+        ok = FALSE;
+      }
+    } else if (argc != 0) {
+      ok = FALSE;
+    }
+    g_strfreev (args);
+
+    if (!ok)
+      write_to_remote (self, "Set the buffering watermarks in percent. "
+          "Usage: +BUFFERING [low high]\n");
+    else
+      send_buffering_stats (self);
+  } else if (g_str_has_prefix (line, "+THREADS ")) {
+    if (!thread_rule_set (self, line + sizeof ("+THREADS"))) {
+      write_to_remote (self, "Place streaming threads of an element, or * "
+          "for all, when they start. Usage: +THREADS element cpus|- "
+          "[nice level|fifo priority|rr priority]\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+THREADS")) {
+    send_thread_rules (self);
+  } else if (g_str_has_prefix (line, "-THREADS")) {
+    g_mutex_lock (&self->threads_lock);
+    if (line[sizeof ("-THREADS") - 1] == ' ')
+      ok = g_hash_table_remove (self->thread_rules,
+          line + sizeof ("-THREADS"));
+    else
+      g_hash_table_remove_all (self->thread_rules);
+    g_mutex_unlock (&self->threads_lock);
+  } else if (g_str_has_prefix (line, "+POOL ")) {
+    if (!pool_rule_set (self, line + sizeof ("+POOL"))) {
+      write_to_remote (self, "Override the buffer pool proposed to the "
+          "element's upstream, max 0 is unlimited. "
+          "Usage: +POOL element min max [size]\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+POOL")) {
+    send_pool_stats (self);
+  } else if (g_str_has_prefix (line, "-POOL")) {
+    g_mutex_lock (&self->pools_lock);
+    if (line[sizeof ("-POOL") - 1] == ' ')
+      ok = g_hash_table_remove (self->pool_rules, line + sizeof ("-POOL"));
+    else
+      g_hash_table_remove_all (self->pool_rules);
+    g_mutex_unlock (&self->pools_lock);
+  } else if (g_str_has_prefix (line, "+SET ")) {
+    gchar *equals = strchr (line, '=');
+
+    if (equals) {
+      *equals = '\0';
+      ok = set_property (self, g_strstrip (line + sizeof ("+SET")),
+          equals + 1);
+    } else {
+      write_to_remote (self, "Change a property of the running pipeline. "
+          "Usage: +SET element.property=value\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+LATENCY ")) {
+    const gchar *arg = line + sizeof ("+LATENCY");
+    gchar *endptr = NULL;
+    gdouble ms = g_ascii_strtod (arg, &endptr);
+
+    if (g_str_equal (arg, "auto")) {
+      self->latency = GST_CLOCK_TIME_NONE;
+    } else if (endptr != arg && *endptr == '\0' && ms >= 0) {
+      self->latency = ms * GST_MSECOND;
+    } else {
+      write_to_remote (self, "Override the latency of this and later "
+          "pipelines. Usage: +LATENCY ms|auto\n");
+      ok = FALSE;
+    }
+
+    /* The pipeline redistributes the latency with the next query */
+    if (ok && self->pipeline && GST_IS_PIPELINE (self->pipeline)) {
+      gst_pipeline_set_latency (GST_PIPELINE (self->pipeline), self->latency);
+      gst_bin_recalculate_latency (GST_BIN (self->pipeline));
+      ok = send_latency (self);
+    }
+  } else if (g_str_has_prefix (line, "+LATENCY")) {
+    ok = send_latency (self);
+  } else if (g_str_has_prefix (line, "+REPLACE ")) {
+    gchar **args = g_strsplit (line + sizeof ("+REPLACE"), " ", 2);
+
+    if (g_strv_length (args) == 2 && *args[0] && *args[1]) {
+      ok = replace_start (self, args[0], args[1]);
+    } else {
+      write_to_remote (self, "Swap an element of the running pipeline "
+          "for a new bin. Usage: +REPLACE element bin-description\n");
+      ok = FALSE;
+    }
+    g_strfreev (args);
+  } else if (g_str_has_prefix (line, "-REPLACE")) {
+    ok = replace_stop (self, FALSE);
+    if (!ok)
+      write_to_remote (self, "REPLACE: already draining, can't cancel\n");
+  } else if (g_str_has_prefix (line, "+GET ")) {
+    ok = get_property (self, g_strstrip (line + sizeof ("+GET")));
+  } else if (g_str_has_prefix (line, "+LOOP ")) {
+    gchar *endptr = NULL;
+    guint64 count = g_ascii_strtoull (line + sizeof ("+LOOP"), &endptr, 10);
+
+    if (*endptr != '\0' || count == 0 || count > G_MAXUINT) {
+      write_to_remote (self, "Play the media repeatedly without rebuilding "
+          "the pipeline. Usage: +LOOP iterations\n");
+      ok = FALSE;
+    } else {
+      ok = loop_start (self, count);
+    }
+  } else if (g_str_has_prefix (line, "+LOOP")) {
+    if (self->loop_count)
+      send_loop_stats (self, "running");
+    else
+      write_to_remote (self, "LOOP: not running\n");
+  } else if (g_str_has_prefix (line, "-LOOP")) {
+    loop_stop (self);
+  } else if (g_str_has_prefix (line, "+STALL ")) {
+    gchar *endptr = NULL;
+    guint64 timeout = g_ascii_strtoull (line + sizeof ("+STALL"), &endptr, 10);
+    gboolean restart = strcmp (endptr, " restart") == 0;
+
+    if ((*endptr != '\0' && !restart) || timeout > G_MAXUINT) {
+      write_to_remote (self, "Report pipelines that stop making progress "
+          "while playing, 0 disables. Usage: +STALL timeout-ms [restart]\n");
+      ok = FALSE;
+    } else {
+      stall_watchdog_set (self, timeout, restart);
+    }
+  } else if (g_str_has_prefix (line, "+STALL")) {
+    send_stall_stats (self);
+  } else if (g_str_has_prefix (line, "+PREPARE ")) {
+    gchar *description = line + sizeof ("+PREPARE");
+    gboolean instantiate = g_str_has_prefix (description, "instantiate ");
+    GstClockTime start = gst_util_get_timestamp ();
+    guint count;
+
+    if (instantiate)
+      description += sizeof ("instantiate");
+    count = prepare_pipeline (self, description, instantiate);
+    write_to_remote (self, "Prepared %u element factories in %.3fms\n",
+        count, TIME_AS_MS (GST_CLOCK_DIFF (start,
+                gst_util_get_timestamp ())));
+  } else if (g_str_has_prefix (line, "+CALLBACKS ")) {
+    gchar *endptr = NULL;
+    guint64 fps = g_ascii_strtoull (line + sizeof ("+CALLBACKS"), &endptr, 10);
+
+    if (*endptr != '\0' || fps > 1000) {
+      write_to_remote (self, "Cap the rate of application callbacks, 0 calls "
+          "them directly. Usage: +CALLBACKS fps\n");
+      ok = FALSE;
+    } else {
+      set_callback_rate (self, fps);
+    }
+  } else if (g_str_has_prefix (line, "+CALLBACKS")) {
+    gint interval = g_atomic_int_get (&self->callback_interval);
+
+    write_to_remote (self, "Callbacks %s, %d posted, %d delivered\n",
+        interval ? "coalesced" : "direct",
+        g_atomic_int_get (&self->callbacks_posted),
+        g_atomic_int_get (&self->callbacks_delivered));
+  } else if (g_str_has_prefix (line, "+TTFF")) {
+    send_ttff (self);
+  } else if (g_str_has_prefix (line, "+RECORD ")) {
+    ok = record_start (self, line + sizeof ("+RECORD"));
+  } else if (g_str_has_prefix (line, "-RECORD")) {
+    record_stop (self);
+  } else if (g_str_has_prefix (line, "+REPLAY ")) {
+    gchar *path = line + sizeof ("+REPLAY");
+    gboolean fast = g_str_has_suffix (path, " fast");
+
+    if (fast)
+      path[strlen (path) - sizeof (" fast") + 1] = '\0';
+    ok = replay_start (self, path, fast);
+  } else if (g_str_has_prefix (line, "-REPLAY")) {
+    if (self->replay)
+      replay_finish (self, "stopped");
+  } else if (g_str_has_prefix (line, "+SCRIPT ")) {
+    if (!script_start (self, line + sizeof ("+SCRIPT"))) {
+      write_to_remote (self, "Run commands on the device, separated by ';'. "
+          "Waits: 'wait ms' or 'wait playing|paused|ready|null|eos|"
+          "async-done [timeout-ms]'. Usage: +SCRIPT step;step;...\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "-SCRIPT")) {
+    if (self->script)
+      script_finish (self, "stopped");
+  } else if (g_str_has_prefix (line, "+BUSSTAT")) {
+    send_bus_stats (self);
+  } else if (g_str_has_prefix (line, "+PACING")) {
+    send_pacing_stats (self);
+  } else if (g_str_has_prefix (line, "+AUTODUMP ")) {
+    gchar *endptr = NULL;
+    guint64 size =
+        g_ascii_strtoull (line + sizeof ("+AUTODUMP"), &endptr, 10);
+
+    if (*endptr != '\0' || size > G_MAXUINT) {
+      write_to_remote (self, "Keep compressed snapshots of the last state "
+          "changes and errors, 0 disables. Usage: +AUTODUMP count\n");
+      ok = FALSE;
+    } else {
+      autodump_set_size (self, size);
+    }
+  } else if (g_str_has_prefix (line, "+AUTODUMPLIST")) {
+    send_autodump_list (self);
+  } else if (g_str_has_prefix (line, "+AUTODUMPGET ")) {
+    gchar *address = line + sizeof ("+AUTODUMPGET ") - 1;
+    gchar *colon = strchr (address, ':');
+    AutoDump *dump = NULL;
+
+    ok = FALSE;
+    if (colon) {
+      gchar *index_str = NULL;
+      gint port = strtol (colon + 1, &index_str, 10);
+
+      if (*index_str == '\0')
+        dump = g_queue_peek_tail (&self->autodumps);
+      else if (*index_str == ' ')
+        dump = g_queue_peek_nth (&self->autodumps,
+            g_ascii_strtoull (index_str, NULL, 10));
+
+      if (port > 0 && dump) {
+        *colon = '\0';
+        send_data_async (address, port, dump->data, FALSE);
+        ok = TRUE;
+      }
+    } else {
+      write_to_remote (self, "Send a gzipped snapshot, by default the "
+          "latest. Usage: +AUTODUMPGET host-or-IP:port [index]\n");
+    }
+  } else if (g_str_has_prefix (line, "+BENCH FAST")) {
+    const gchar *mode = line + sizeof ("+BENCH FAST") - 1;
+
+    if (*mode == '\0' || g_str_equal (mode, " fakesink")) {
+      ok = bench_fast_start (self, *mode != '\0');
+    } else {
+      write_to_remote (self, "Rerun the pipeline without clock sync and QoS "
+          "on the sinks. Usage: +BENCH FAST [fakesink]\n");
+      ok = FALSE;
+    }
+  } else if (g_str_has_prefix (line, "+BENCH")) {
+    if (self->bench_result)
+      write_to_remote (self, "%s", self->bench_result);
+
+    if (!GST_CLOCK_TIME_IS_VALID (self->last_play_time)) {
+      write_to_remote (self, "Not yet played, no measurement\n");
+    } else if (!GST_CLOCK_TIME_IS_VALID (self->last_eos_time)) {
+      GstClockTimeDiff diff =
+          GST_CLOCK_DIFF (self->last_play_time, gst_util_get_timestamp ());
+
+      write_to_remote (self, "Has been playing for %" GST_TIME_FORMAT "\n",
+          GST_TIME_ARGS (diff));
+    } else {
+      GstClockTimeDiff diff =
+          GST_CLOCK_DIFF (self->last_play_time, self->last_eos_time);
+
+      write_to_remote (self,
+          "Last playback ended after %" GST_TIME_FORMAT "\n",
+          GST_TIME_ARGS (diff));
+    }
+  } else if (!g_str_has_prefix (line, "+") && !g_str_has_prefix (line, "-")) {
+    gst_launch_remote_set_pipeline (self, line);
+  } else {
+    ok = FALSE;
+  }
+
+  return ok;
 }
 
 static void
@@ -578,185 +6446,15 @@ read_line_cb (GObject * source_object, GAsyncResult * res, gpointer user_data)
   }
 
   GST_DEBUG ("Received command: %s", line);
-  if (line) {
-    gboolean ok = TRUE;
-
-    /* Remove trailing \r if present */
-    line = g_strchomp (line);
-
-    if (g_str_has_prefix (line, "+DEBUG ")) {
-      gchar *address = line + sizeof ("+DEBUG ") - 1;
-      gchar *colon = strchr (address, ':');
-      gchar *cats_str;
-
-      ok = FALSE;
-      if (colon) {
-        gint port = strtol (colon + 1, &cats_str, 10);
-
-        if (port > 0) {
-          GSocketAddress *addr;
-          *colon = '\0';
-
-          addr = g_inet_socket_address_new_from_string (address, port);
-          if (addr) {
-            GList *l;
-
-            G_LOCK (debug_sockets);
-            for (l = debug_sockets; l; l = l->next) {
-              DebugSocket *s = l->data;
-
-              if (s->socket == self->debug_socket) {
-                ok = TRUE;
-                s->address = addr;
-                gst_debug_set_active (TRUE);
-                break;
-              }
-            }
-            if (cats_str && cats_str[0])
-              gst_debug_set_threshold_from_string (cats_str, TRUE);
-            else
-              gst_debug_set_default_threshold (GST_LEVEL_DEBUG);
-            G_UNLOCK (debug_sockets);
-          }
-        }
-      } else {
-        write_to_remote (self, "Usage: +DEBUG host-or-IP:port [debug config]");
-      }
-    } else if (g_str_has_prefix (line, "-DEBUG")) {
-      GList *l;
-      gboolean all_disabled = TRUE;
-
-      G_LOCK (debug_sockets);
-      for (l = debug_sockets; l; l = l->next) {
-        DebugSocket *s = l->data;
-
-        if (s->socket == self->debug_socket) {
-          if (s->address)
-            g_object_unref (s->address);
-          s->address = NULL;
-        }
-
-        all_disabled &= s->address == NULL;
-      }
-      G_UNLOCK (debug_sockets);
-      gst_debug_set_active (!all_disabled);
-      if (!all_disabled)
-        gst_debug_set_default_threshold (GST_LEVEL_DEBUG);
-    } else if (g_str_has_prefix (line, "+PLAY")) {
-      gst_launch_remote_play (self);
-    } else if (g_str_has_prefix (line, "+PAUSE")) {
-      gst_launch_remote_pause (self);
-    } else if (g_str_has_prefix (line, "+SEEK ")) {
-      gchar *position = line + sizeof ("+SEEK ") - 1;
-      gchar *endptr = NULL;
-      guint64 ms = g_ascii_strtoull (position, &endptr, 10);
-
-      if (*endptr == '\0') {
-        gst_launch_remote_seek (self, ms);
-      } else {
-        ok = FALSE;
-      }
-    } else if (g_str_has_prefix (line, "+NETCLOCK ")) {
-      gchar **command;
-
-      if (*(line + sizeof ("+NETCLOCK") - 1) == '\0')
-        command = g_new0 (gchar *, 1);
-      else
-        command = g_strsplit (line + sizeof ("+NETCLOCK"), " ", 2);
-
-      if (self->net_clock)
-        gst_object_unref (self->net_clock);
-      self->net_clock = NULL;
-      if (command[0] && command[1]) {
-        gint64 port = g_ascii_strtoll (command[1], NULL, 10);
-        GST_DEBUG ("Setting netclock %s %" G_GINT64_FORMAT, command[0], port);
-        self->net_clock =
-            gst_net_client_clock_new ("netclock", command[0], port, 0);
-      } else {
-        GST_DEBUG ("Unsetting netclock");
-      }
-
-      g_strfreev (command);
-    } else if (g_str_has_prefix (line, "+BASETIME ")) {
-      gchar *endptr = NULL;
-      guint64 base_time =
-          g_ascii_strtoull (line + sizeof ("+BASETIME"), &endptr, 10);
-
-      if (*endptr != '\0') {
-        ok = FALSE;
-        self->base_time = GST_CLOCK_TIME_NONE;
-      } else {
-        self->base_time = base_time;
-        GST_DEBUG ("Setting base time %" GST_TIME_FORMAT,
-            GST_TIME_ARGS (base_time));
-        if (self->pipeline) {
-          gst_element_set_base_time (self->pipeline, base_time);
-          gst_element_set_start_time (self->pipeline, GST_CLOCK_TIME_NONE);
-        }
-      }
-    } else if (g_str_has_prefix (line, "+STAT")) {
-      GstClockTime position = -1, duration = -1;
-      gchar *tmp;
-      GstState s = GST_STATE_VOID_PENDING;
-
-      if (self->pipeline) {
-        gst_element_query_duration (self->pipeline, GST_FORMAT_TIME, &duration);
-        gst_element_query_position (self->pipeline, GST_FORMAT_TIME, &position);
-        s = GST_STATE (self->pipeline);
-      }
-
-      tmp =
-          g_strdup_printf ("%" GST_TIME_FORMAT " / %" GST_TIME_FORMAT
-          " @ %s\nLast message: %s\n", GST_TIME_ARGS (position),
-          GST_TIME_ARGS (duration), gst_element_state_get_name (s),
-          GST_STR_NULL (self->last_message));
-      g_output_stream_write_all (self->ostream, tmp, strlen (tmp), NULL, NULL,
-          NULL);
-      g_free (tmp);
-    } else if (g_str_has_prefix (line, "+DUMP ")) {
-      gchar *address = line + sizeof ("+DUMP ") - 1;
-      gchar *colon = strchr (address, ':');
-      if (colon) {
-        gint port = strtol (colon + 1, NULL, 10);
-
-        if (port > 0) {
-          *colon = '\0';
-          send_pipeline_dump (self, address, port);
-        }
-      } else {
-        write_to_remote (self,
-            "Send a pipeline .dot dump to a remote port. Usage: +DUMP host-or-IP:port\n");
-      }
-    } else if (g_str_has_prefix (line, "+BENCH")) {
-      if (!GST_CLOCK_TIME_IS_VALID (self->last_play_time)) {
-        write_to_remote (self, "Not yet played, no measurement\n");
-      } else if (!GST_CLOCK_TIME_IS_VALID (self->last_eos_time)) {
-        GstClockTimeDiff diff =
-            GST_CLOCK_DIFF (self->last_play_time, gst_util_get_timestamp ());
-
-        write_to_remote (self, "Has been playing for %" GST_TIME_FORMAT "\n",
-            GST_TIME_ARGS (diff));
-      } else {
-        GstClockTimeDiff diff =
-            GST_CLOCK_DIFF (self->last_play_time, self->last_eos_time);
 
-        write_to_remote (self,
-            "Last playback ended after %" GST_TIME_FORMAT "\n",
-            GST_TIME_ARGS (diff));
-      }
-    } else if (!g_str_has_prefix (line, "+") && !g_str_has_prefix (line, "-")) {
-      gst_launch_remote_set_pipeline (self, line);
-    } else {
-      ok = FALSE;
-    }
+  /* Remove trailing \r if present */
+  line = g_strchomp (line);
+  record_command (self, line);
 
-    if (ok)
-      outline = g_strdup ("OK\n");
-    else
-      outline = g_strdup ("NOK\n");
-  } else {
+  if (handle_command (self, line))
+    outline = g_strdup ("OK\n");
+  else
     outline = g_strdup ("NOK\n");
-  }
   g_free (line);
 
   if (!g_output_stream_write_all (self->ostream, outline, strlen (outline),
@@ -781,6 +6479,11 @@ incoming_cb (GSocketService * service, GSocketConnection * connection,
   GIOStream *stream;
   GInputStream *istream;
 
+  if (source_object && source_object == self->metrics_source) {
+    metrics_incoming (self, connection);
+    return TRUE;
+  }
+
   if (self->connection) {
     GST_ERROR ("ERROR: Already have a connection\n");
     return FALSE;
@@ -798,6 +6501,70 @@ incoming_cb (GSocketService * service, GSocketConnection * connection,
   return TRUE;
 }
 
+/* One-shot, the first buffer reaching any sink wins */
+static GstPadProbeReturn
+ttff_probe_cb (GstPad * pad, GstPadProbeInfo * info, GstLaunchRemote * self)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  if (g_atomic_int_compare_and_exchange (&self->ttff_first_buffer_seen, FALSE,
+          TRUE))
+    self->ttff_first_buffer = now;
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+ttff_probe_install (GstElement * element, GstLaunchRemote * self)
+{
+  GstPad *sinkpad;
+
+  if (!GST_OBJECT_FLAG_IS_SET (element, GST_ELEMENT_FLAG_SINK)
+      || GST_IS_BIN (element))
+    return;
+
+  sinkpad = get_sink_pad (element);
+  if (!sinkpad)
+    return;
+
+  gst_pad_add_probe (sinkpad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) ttff_probe_cb, self, NULL);
+  gst_object_unref (sinkpad);
+}
+
+static void
+ttff_probe_install_item (const GValue * item, gpointer user_data)
+{
+  ttff_probe_install (g_value_get_object (item), user_data);
+}
+
+/* Sinks created later by auto-plugging bins */
+static void
+ttff_element_added_cb (GstBin * bin, GstBin * sub_bin, GstElement * element,
+    GstLaunchRemote * self)
+{
+  ttff_probe_install (element, self);
+}
+
+/* Installed before the first state change, so the preroll buffer is seen */
+static void
+ttff_probes_install (GstLaunchRemote * self)
+{
+  GstIterator *it;
+
+  if (!GST_IS_BIN (self->pipeline))
+    return;
+
+  g_signal_connect (self->pipeline, "deep-element-added",
+      G_CALLBACK (ttff_element_added_cb), self);
+  it = gst_bin_iterate_recurse (GST_BIN (self->pipeline));
+  while (gst_iterator_foreach (it, ttff_probe_install_item,
+          self) == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+}
+
 static void
 gst_launch_remote_set_pipeline (GstLaunchRemote * self,
     const gchar * pipeline_string)
@@ -806,26 +6573,41 @@ gst_launch_remote_set_pipeline (GstLaunchRemote * self,
   GSource *bus_source;
   GError *err = NULL;
 
-  if (self->pipeline) {
-    gst_element_set_state (self->pipeline, GST_STATE_NULL);
-    gst_object_unref (self->pipeline);
-    if (self->video_sink)
-      gst_object_unref (self->video_sink);
-    self->pipeline = NULL;
-    self->video_sink = NULL;
-  }
+  if (self->pipeline)
+    free_pipeline (self);
 
   g_free (self->pipeline_string);
   self->pipeline_string = NULL;
   self->target_state = GST_STATE_NULL;
+  self->bench_fast = FALSE;
   self->last_play_time = GST_CLOCK_TIME_NONE;
   self->last_eos_time = GST_CLOCK_TIME_NONE;
+  pacing_reset (self);
+  g_hash_table_remove_all (self->bus_source_stats);
+  g_mutex_lock (&self->pools_lock);
+  g_ptr_array_set_size (self->pools, 0);
+  g_mutex_unlock (&self->pools_lock);
+  self->buffering_paused = FALSE;
+  self->played = FALSE;
+  self->rebuffer_count = 0;
+  self->rebuffer_total = 0;
+  self->rebuffer_max = 0;
+  self->ttff_start = GST_CLOCK_TIME_NONE;
+  self->ttff_parsed = GST_CLOCK_TIME_NONE;
+  self->ttff_prerolled = GST_CLOCK_TIME_NONE;
+  self->ttff_first_buffer = GST_CLOCK_TIME_NONE;
+  self->ttff_first_buffer_seen = FALSE;
+  self->ttff_playing = GST_CLOCK_TIME_NONE;
+  self->stall_last_buffers = -1;
+  self->stall_last_position = -1;
 
   if (!pipeline_string)
     return;
 
   self->pipeline_string = g_strdup (pipeline_string);
+  self->ttff_start = gst_util_get_timestamp ();
   self->pipeline = gst_parse_launch (pipeline_string, &err);
+  self->ttff_parsed = gst_util_get_timestamp ();
   if (err) {
     set_message (self, "Unable to build pipeline '%s': %s", pipeline_string,
         err->message);
@@ -835,28 +6617,23 @@ gst_launch_remote_set_pipeline (GstLaunchRemote * self,
 
   bus = gst_element_get_bus (self->pipeline);
   bus_source = gst_bus_create_watch (bus);
-  g_source_set_callback (bus_source, (GSourceFunc) gst_bus_async_signal_func,
-      NULL, NULL);
+  g_source_set_callback (bus_source, (GSourceFunc) bus_watch_cb, self, NULL);
   g_source_attach (bus_source, self->context);
   g_source_unref (bus_source);
-  g_signal_connect (G_OBJECT (bus), "message::error", (GCallback) error_cb,
-      self);
-  g_signal_connect (G_OBJECT (bus), "message::eos", (GCallback) eos_cb, self);
-  g_signal_connect (G_OBJECT (bus), "message::state-changed",
-      (GCallback) state_changed_cb, self);
-  g_signal_connect (G_OBJECT (bus), "message::buffering",
-      (GCallback) buffering_cb, self);
-  g_signal_connect (G_OBJECT (bus), "message::clock-lost",
-      (GCallback) clock_lost_cb, self);
-
-  gst_bus_enable_sync_message_emission (bus);
-  g_signal_connect (G_OBJECT (bus), "sync-message", (GCallback) sync_message_cb,
-      self);
-
+  gst_bus_set_sync_handler (bus, (GstBusSyncHandler) bus_sync_handler, self,
+      NULL);
   gst_object_unref (bus);
 
-  if (self->net_clock)
-    gst_pipeline_use_clock (GST_PIPELINE (self->pipeline), self->net_clock);
+  pool_rules_install (self);
+  ttff_probes_install (self);
+
+  if (GST_CLOCK_TIME_IS_VALID (self->latency)
+      && GST_IS_PIPELINE (self->pipeline))
+    gst_pipeline_set_latency (GST_PIPELINE (self->pipeline), self->latency);
+
+  if (get_forced_clock (self))
+    gst_pipeline_use_clock (GST_PIPELINE (self->pipeline),
+        get_forced_clock (self));
 
   if (self->base_time != GST_CLOCK_TIME_NONE) {
     gst_element_set_base_time (self->pipeline, self->base_time);
@@ -868,7 +6645,6 @@ static gpointer
 gst_launch_remote_main (gpointer user_data)
 {
   GstLaunchRemote *self = user_data;
-  GSource *timeout_source;
   GSocketAddress *bind_addr;
   GInetAddress *bind_iaddr;
   GError *err = NULL;
@@ -933,13 +6709,14 @@ gst_launch_remote_main (gpointer user_data)
   g_object_unref (bind_addr);
   g_object_unref (bind_iaddr);
 
-  gst_launch_remote_set_pipeline (self, "fakesrc ! fakesink");
+  if (self->startup_prepare) {
+    gchar **description;
 
-  timeout_source = g_timeout_source_new (250);
-  g_source_set_callback (timeout_source, (GSourceFunc) update_position_cb, self,
-      NULL);
-  g_source_attach (timeout_source, self->context);
-  g_source_unref (timeout_source);
+    for (description = self->startup_prepare; *description; description++)
+      prepare_pipeline (self, *description, FALSE);
+  }
+
+  gst_launch_remote_set_pipeline (self, "fakesrc ! fakesink");
 
   GST_DEBUG ("Starting main loop");
   self->main_loop = g_main_loop_new (self->context, FALSE);
@@ -953,10 +6730,13 @@ gst_launch_remote_main (gpointer user_data)
     g_socket_service_stop (self->service);
     g_object_unref (self->service);
   }
+  if (self->metrics_source)
+    g_object_unref (self->metrics_source);
 
   if (self->connection) {
     g_object_unref (self->distream);
     g_object_unref (self->connection);
+    self->connection = NULL;
   }
 
   if (self->debug_socket) {
@@ -980,17 +6760,20 @@ gst_launch_remote_main (gpointer user_data)
   }
 
   /* Free resources */
+  self->target_state = GST_STATE_NULL;
+  if (self->pipeline)
+    free_pipeline (self);
+  script_stop (self);
+  replay_stop (self);
+  stall_watchdog_set (self, 0, FALSE);
+  record_stop (self);
+  clock_test_stop (self);
+  time_provider_stop (self);
+  net_clock_clear (self);
+  autodump_set_size (self, 0);
   g_main_context_pop_thread_default (self->context);
   g_main_context_unref (self->context);
-  self->target_state = GST_STATE_NULL;
-  if (self->pipeline) {
-    gst_element_set_state (self->pipeline, GST_STATE_NULL);
-    gst_object_unref (self->pipeline);
-    if (self->video_sink)
-      gst_object_unref (self->video_sink);
-    self->pipeline = NULL;
-    self->video_sink = NULL;
-  }
+  g_free (self->bench_result);
   g_free (self->pipeline_string);
 
   return NULL;
@@ -1015,6 +6798,14 @@ gst_launch_remote_init (gpointer user_data)
   gst_debug_set_active (FALSE);
 
   start_time = gst_util_get_timestamp ();
+  pad_counter_quark =
+      g_quark_from_static_string ("gst-launch-remote-pad-counter");
+  pool_stats_quark =
+      g_quark_from_static_string ("gst-launch-remote-pool-stats");
+  pool_probe_quark =
+      g_quark_from_static_string ("gst-launch-remote-pool-probe");
+  stall_probe_quark =
+      g_quark_from_static_string ("gst-launch-remote-stall-probe");
 
   return NULL;
 }
@@ -1028,7 +6819,42 @@ gst_launch_remote_new (const GstLaunchRemoteAppContext * ctx)
   g_once (&once, gst_launch_remote_init, NULL);
 
   self->app_context = *ctx;
+  /* The caller's list does not have to outlive this call */
+  self->startup_prepare = g_strdupv ((gchar **) ctx->prepare_pipelines);
+  self->app_context.prepare_pipelines = NULL;
+  set_callback_rate (self, CALLBACK_DEFAULT_FPS);
+  self->callback_context = g_main_context_new ();
+  self->callback_loop = g_main_loop_new (self->callback_context, FALSE);
+  self->callback_thread = g_thread_new ("gst-launch-remote-callbacks",
+      (GThreadFunc) callback_thread_func, self);
   self->base_time = GST_CLOCK_TIME_NONE;
+  self->latency = GST_CLOCK_TIME_NONE;
+  self->position_interval = 250;
+  self->duration = -1;
+  self->buffering_low = 10;
+  self->buffering_high = 100;
+  self->stall_start = GST_CLOCK_TIME_NONE;
+  self->last_sync_wait = GST_CLOCK_TIME_NONE;
+  self->seek_start_time = GST_CLOCK_TIME_NONE;
+  self->last_seek_async_done = GST_CLOCK_TIME_NONE;
+  self->last_seek_first_buffer = GST_CLOCK_TIME_NONE;
+  self->seek_bench_async_done =
+      g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+  self->seek_bench_first_buffer =
+      g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+  self->qos_stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) qos_stats_free);
+  self->bus_source_stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) bus_stats_free);
+  g_mutex_init (&self->pools_lock);
+  self->pool_rules = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) pool_rule_free);
+  self->pools =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) pool_entry_free);
+  g_mutex_init (&self->threads_lock);
+  self->thread_rules = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) thread_rule_free);
+
   self->thread =
       g_thread_new ("gst-launch-remote", gst_launch_remote_main, self);
   g_mutex_init (&self->lock);
@@ -1042,25 +6868,42 @@ gst_launch_remote_new (const GstLaunchRemoteAppContext * ctx)
 void
 gst_launch_remote_free (GstLaunchRemote * self)
 {
+  guint i;
+
   g_main_loop_quit (self->main_loop);
   g_thread_join (self->thread);
+  /* Deliver what the main loop posted while shutting down */
+  g_main_context_invoke (self->callback_context,
+      (GSourceFunc) callback_shutdown_cb, self);
+  g_thread_join (self->callback_thread);
+  g_main_loop_unref (self->callback_loop);
+  g_main_context_unref (self->callback_context);
+  for (i = 0; i < G_N_ELEMENTS (self->callback_mailbox); i++)
+    if (self->callback_mailbox[i])
+      callback_update_free (self->callback_mailbox[i]);
   g_mutex_clear (&self->lock);
+  g_array_free (self->seek_bench_async_done, TRUE);
+  g_array_free (self->seek_bench_first_buffer, TRUE);
+  g_hash_table_unref (self->qos_stats);
+  g_hash_table_unref (self->bus_source_stats);
+  g_strfreev (self->startup_prepare);
+  g_free (self->stall_diagnostics);
+  g_hash_table_unref (self->pool_rules);
+  g_ptr_array_unref (self->pools);
+  g_mutex_clear (&self->pools_lock);
+  g_hash_table_unref (self->thread_rules);
+  g_mutex_clear (&self->threads_lock);
   g_slice_free (GstLaunchRemote, self);
 }
 
-void
-gst_launch_remote_play (GstLaunchRemote * self)
+static void
+set_playing (GstLaunchRemote * self)
 {
   GstStateChangeReturn state_ret;
 
-  if (!self || !self->pipeline_string)
+  if (!self->pipeline)
     return;
 
-  if (!self->pipeline) {
-    gchar *pipeline_string = g_strdup (self->pipeline_string);
-    gst_launch_remote_set_pipeline (self, pipeline_string);
-    g_free (pipeline_string);
-  }
   GST_DEBUG ("Setting state to PLAYING");
 
   self->last_play_time = gst_util_get_timestamp ();
@@ -1075,12 +6918,38 @@ gst_launch_remote_play (GstLaunchRemote * self)
   }
 }
 
-void
-gst_launch_remote_pause (GstLaunchRemote * self)
+static void
+play_pipeline (GstLaunchRemote * self)
+{
+  if (!self->pipeline_string)
+    return;
+
+  if (!self->pipeline) {
+    gchar *pipeline_string = g_strdup (self->pipeline_string);
+    gst_launch_remote_set_pipeline (self, pipeline_string);
+    g_free (pipeline_string);
+  }
+
+  if (self->sync_wait_source)
+    return;
+
+  /* Preroll while the net clock converges */
+  if (self->net_clock && self->sync_timeout > 0
+      && !gst_clock_is_synced (self->net_clock)) {
+    pause_pipeline (self);
+    sync_wait_start (self);
+    return;
+  }
+
+  set_playing (self);
+}
+
+static void
+pause_pipeline (GstLaunchRemote * self)
 {
   GstStateChangeReturn state_ret;
 
-  if (!self || !self->pipeline_string)
+  if (!self->pipeline_string)
     return;
 
   if (!self->pipeline) {
@@ -1091,6 +6960,10 @@ gst_launch_remote_pause (GstLaunchRemote * self)
 
   GST_DEBUG ("Setting state to PAUSED");
 
+  sync_wait_stop (self);
+  if (self->playat_id)
+    playat_stop (self);
+  rebuffer_end (self);
   self->target_state = GST_STATE_PAUSED;
   state_ret = gst_element_set_state (self->pipeline, GST_STATE_PAUSED);
   self->is_live = (state_ret == GST_STATE_CHANGE_NO_PREROLL);
@@ -1101,24 +6974,81 @@ gst_launch_remote_pause (GstLaunchRemote * self)
   }
 }
 
+static gboolean
+play_request_cb (GstLaunchRemote * self)
+{
+  play_pipeline (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+pause_request_cb (GstLaunchRemote * self)
+{
+  pause_pipeline (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* May be called from any thread, the state change is done from the main
+ * loop like everything else touching the pipeline */
 void
-gst_launch_remote_seek (GstLaunchRemote * self, gint position_ms)
+gst_launch_remote_play (GstLaunchRemote * self)
 {
-  GstClockTime position;
+  if (!self || !self->context)
+    return;
 
-  if (!self || !self->pipeline)
+  g_main_context_invoke_full (self->context, G_PRIORITY_DEFAULT,
+      (GSourceFunc) play_request_cb, self, NULL);
+}
+
+/* May be called from any thread, see gst_launch_remote_play() */
+void
+gst_launch_remote_pause (GstLaunchRemote * self)
+{
+  if (!self || !self->context)
     return;
 
-  position = gst_util_uint64_scale (position_ms, GST_MSECOND, 1);
-  GST_DEBUG ("Seeking to %" GST_TIME_FORMAT, GST_TIME_ARGS (position));
+  g_main_context_invoke_full (self->context, G_PRIORITY_DEFAULT,
+      (GSourceFunc) pause_request_cb, self, NULL);
+}
 
-  if (!gst_element_seek_simple (self->pipeline, GST_FORMAT_TIME,
-          GST_SEEK_FLAG_FLUSH, position)) {
-    GST_ERROR ("Seeking failed");
-    set_message (self, "Seeking failed");
-  } else {
-    GST_DEBUG ("Seek successful");
-  }
+typedef struct
+{
+  GstLaunchRemote *self;
+  gint position_ms;
+} SeekRequest;
+
+static void
+seek_request_free (SeekRequest * request)
+{
+  g_slice_free (SeekRequest, request);
+}
+
+static gboolean
+seek_request_cb (SeekRequest * request)
+{
+  seek_start (request->self, request->position_ms);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* May be called from any thread, the seek is done from the main loop like
+ * everything else touching the pipeline */
+void
+gst_launch_remote_seek (GstLaunchRemote * self, gint position_ms)
+{
+  SeekRequest *request;
+
+  if (!self || !self->context)
+    return;
+
+  request = g_slice_new (SeekRequest);
+  request->self = self;
+  request->position_ms = position_ms;
+  g_main_context_invoke_full (self->context, G_PRIORITY_DEFAULT,
+      (GSourceFunc) seek_request_cb, request,
+      (GDestroyNotify) seek_request_free);
 }
 
 void
@@ -1149,12 +7079,7 @@ gst_launch_remote_set_window_handle (GstLaunchRemote * self, guintptr handle)
     if (self->video_sink) {
       gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (self->video_sink),
           (guintptr) NULL);
-      gst_element_set_state (self->pipeline, GST_STATE_NULL);
-      gst_object_unref (self->pipeline);
-      if (self->video_sink)
-        gst_object_unref (self->video_sink);
-      self->pipeline = NULL;
-      self->video_sink = NULL;
+      free_pipeline (self);
     }
   }
 
@@ -24,15 +24,31 @@
 #include <gio/gio.h>
 #include <gst/gst.h>
 #include <gst/video/video.h>
+#include <gst/net/net.h>
 
 #define PORT 9123
 
+/* Log2 buckets of microseconds, the last one collects everything above */
+#define HISTOGRAM_BUCKETS 20
+
+typedef struct {
+  gint buckets[HISTOGRAM_BUCKETS];
+  gint negative;
+  gint count;
+  GstClockTime sum;
+  GstClockTime negative_sum;
+  GstClockTime max;
+} GstLaunchRemoteHistogram;
+
 typedef struct {
   gpointer app;
   void (*set_message) (const gchar *message, gpointer app);
   void (*set_current_position) (gint position, gint duration, gpointer app);
   void (*initialized) (gpointer app);
   void (*media_size_changed) (gint width, gint height, gpointer app);
+  /* NULL-terminated pipeline descriptions whose elements are loaded at
+   * startup, or NULL */
+  const gchar * const *prepare_pipelines;
 } GstLaunchRemoteAppContext;
 
 typedef struct {
@@ -53,6 +69,37 @@ typedef struct {
 
   GstClock *net_clock;
   GstClockTime base_time;
+  GstClockTime latency;
+  GstBus *net_clock_bus;
+  GSource *net_clock_bus_source;
+  GstStructure *net_clock_stats;
+  GstClockTime net_clock_start_time;
+  GstClockTime net_clock_sync_time;
+  guint net_clock_updates;
+  guint net_clock_discontinuities;
+  GstClockTime net_clock_max_discontinuity;
+
+  GstNetTimeProvider *time_provider;
+  GstClock *provided_clock;
+  gint provided_port;
+  GPtrArray *clock_test_clocks;
+  GPtrArray *clock_test_providers;
+  GSource *clock_test_source;
+  GstClockTime clock_test_start;
+  guint clock_test_timeout;
+
+  GstClock *playat_clock;
+  GstClockID playat_id;
+  GstClockTime playat_time;
+  gboolean playat_reported;
+
+  guint sync_timeout;
+  gulong sync_handler_id;
+  GSource *sync_wait_source;
+  guint sync_wait_seqnum;
+  GstClockTime sync_wait_start;
+  GstClockTime last_sync_wait;
+  gboolean last_sync_wait_timed_out;
 
   GMutex lock;
   GSocketService *service;
@@ -62,9 +109,132 @@ typedef struct {
   GSocket *debug_socket;
 
   GstLaunchRemoteAppContext app_context;
+  GThread *callback_thread;
+  GMainContext *callback_context;
+  GMainLoop *callback_loop;
+  gpointer callback_mailbox[3];
+  gint callback_interval;
+  gint callback_flush_pending;
+  gint callbacks_posted;
+  gint callbacks_delivered;
 
   GstClockTime last_play_time;
   GstClockTime last_eos_time;
+
+  gchar **startup_prepare;
+  guint prepared_factories;
+  GstClockTime prepare_time;
+  GstClockTime ttff_start;
+  GstClockTime ttff_parsed;
+  GstClockTime ttff_prerolled;
+  GstClockTime ttff_first_buffer;
+  gint ttff_first_buffer_seen;
+  GstClockTime ttff_playing;
+
+  GstSeekFlags seek_flags;
+  GstClockTime seek_start_time;
+  GstClockTime seek_async_done_time;
+  GstClockTime seek_first_buffer_time;
+  GstClockTime last_seek_async_done;
+  GstClockTime last_seek_first_buffer;
+  guint32 seek_seqnum;
+  gint seek_flushed;
+  gint seek_first_buffer_posted;
+  GstPad *seek_probe_pad;
+  gulong seek_probe_id;
+
+  guint seek_bench_count;
+  guint seek_bench_index;
+  gboolean seek_bench_random;
+  guint seek_bench_failures;
+  GArray *seek_bench_async_done;
+  GArray *seek_bench_first_buffer;
+  GSource *seek_bench_source;
+
+  GHashTable *qos_stats;
+  GstPad *pacing_pad;
+  gulong pacing_probe_id;
+  GstClockTime pacing_last_arrival;
+  GstLaunchRemoteHistogram pacing_intervals;
+  GstLaunchRemoteHistogram pacing_lateness;
+
+  GObject *metrics_source;
+  gint buffering_percent;
+  guint buffering_low;
+  guint buffering_high;
+  gboolean buffering_paused;
+  gboolean buffering_initial;
+  gboolean played;
+  gint buffering_rate;
+  GstClockTime rebuffer_start;
+  guint rebuffer_count;
+  GstClockTime rebuffer_total;
+  GstClockTime rebuffer_max;
+  gint bus_message_counts[32];
+  GstClockTime bus_message_time[32];
+  GHashTable *bus_source_stats;
+
+  GPtrArray *script;
+  guint script_index;
+  GSource *script_source;
+  guint script_events;
+  GstClockTime script_start;
+
+  GOutputStream *record_stream;
+  GstClockTime record_start;
+  GPtrArray *replay;
+  guint replay_index;
+  GSource *replay_source;
+  GstClockTime replay_start;
+  gboolean replay_fast;
+  guint replay_failed;
+  GstClockTime replay_max_lateness;
+
+  GMutex pools_lock;
+  GHashTable *pool_rules;
+  GPtrArray *pools;
+
+  GMutex threads_lock;
+  GHashTable *thread_rules;
+  guint streaming_threads;
+
+  GQueue autodumps;
+  guint autodump_size;
+
+  gpointer replace;
+
+  gboolean pad_counters;
+  gboolean bench_fast;
+  gint64 bench_cpu_start;
+  gchar *bench_result;
+
+  guint loop_count;
+  guint loop_index;
+  GstClockTime loop_start;
+  GstClockTime loop_iteration_start;
+  GstClockTimeDiff loop_drift;
+  GstLaunchRemoteHistogram loop_drifts;
+  gint64 loop_rss_start;
+  gint64 loop_rss_last;
+  gint64 loop_rss_max;
+
+  guint stall_timeout;
+  gboolean stall_restart;
+  GSource *stall_source;
+  gint stall_buffers;
+  GstClockTime stall_last_progress;
+  gint64 stall_last_buffers;
+  gint64 stall_last_position;
+  GstClockTime stall_start;
+  guint stall_count;
+  guint stall_restarts;
+  GstClockTime stall_total;
+  GstClockTime stall_max;
+  gchar *stall_diagnostics;
+
+  GSource *position_source;
+  guint position_interval;
+  gint64 duration;
 } GstLaunchRemote;
 
 /* Set callbacks manually as required */
@@ -97,7 +97,7 @@ void media_size_changed_proxy (gint width, gint height, gpointer app)
     media_width = 320;
     media_height = 240;
     
-    GstLaunchRemoteAppContext ctx;
+    GstLaunchRemoteAppContext ctx = { 0 };
     ctx.app = (__bridge gpointer)(self);
     ctx.initialized = initialized_proxy;
     ctx.media_size_changed = media_size_changed_proxy;
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+#
+# Regression check: replaying a session must not crash when commands that
+# reply, like +STAT, run while no control client is connected.
+#
+# Records a session with a delayed +STAT on the device, replays it, and
+# disconnects before the +STAT is replayed. Then reconnects and checks that
+# the app still answers.
+#
+# Usage: check-replay-without-client.py host [path-on-device]
+
+import socket
+import sys
+import time
+
+PORT = 9123
+
+
+def command(sock, line):
+    sock.sendall((line + "\n").encode())
+    reply = b""
+    while not (reply.endswith(b"OK\n") or reply.endswith(b"NOK\n")):
+        data = sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed after " + line)
+        reply += data
+    return reply.decode(errors="replace").splitlines()[-1] == "OK"
+
+
+def connect(host):
+    return socket.create_connection((host, PORT), timeout=10)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s host [path-on-device]" % sys.argv[0])
+        return 2
+
+    host = sys.argv[1]
+    path = sys.argv[2] if len(sys.argv) > 2 else "/tmp/replay-stat-check"
+
+    sock = connect(host)
+    if not command(sock, "+RECORD " + path):
+        print("FAIL: can't record to " + path)
+        return 1
+    time.sleep(1)
+    command(sock, "+STAT")
+    command(sock, "-RECORD")
+
+    # The recorded +STAT runs one second after this, without a client
+    if not command(sock, "+REPLAY " + path):
+        print("FAIL: can't replay " + path)
+        return 1
+    sock.close()
+    time.sleep(3)
+
+    try:
+        sock = connect(host)
+        alive = command(sock, "+STAT")
+        sock.close()
+    except OSError as e:
+        print("FAIL: app did not answer after the replay: %s" % e)
+        return 1
+
+    print("PASS" if alive else "FAIL: +STAT failed after the replay")
+    return 0 if alive else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
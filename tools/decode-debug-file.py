@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+#
+# Decodes a circular log file written after +DEBUGFILE into plain text, with
+# the oldest record first. Pull the file from the device first, e.g. with
+# "adb pull".
+#
+# File layout, all integers little endian:
+#   char    magic[8]      "GSTLRLOG"
+#   uint32  version       1
+#   uint32  header_size   offset of the data area
+#   uint64  size          size of the data area
+#   uint64  write_pos     bytes ever written to the data area
+# If write_pos > size the log wrapped around and the oldest data starts at
+# write_pos % size, beginning with a partial record that is skipped.
+#
+# Usage: decode-debug-file.py file [output]
+
+import struct
+import sys
+
+MAGIC = b"GSTLRLOG"
+HEADER = struct.Struct("<8sIIQQ")
+
+
+def decode(contents):
+    if len(contents) < HEADER.size:
+        raise ValueError("file too short")
+
+    magic, version, header_size, size, write_pos = \
+        HEADER.unpack_from(contents)
+    if magic != MAGIC:
+        raise ValueError("not a debug file")
+    if version != 1:
+        raise ValueError("unsupported version %d" % version)
+
+    area = contents[header_size:header_size + size]
+    if len(area) < size:
+        raise ValueError("data area truncated")
+
+    if write_pos <= size:
+        return area[:write_pos]
+
+    start = write_pos % size
+    data = area[start:] + area[:start]
+    # Drop the partial record the wrap-around cut into
+    newline = data.find(b"\n")
+    return data[newline + 1:] if newline >= 0 else b""
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s file [output]" % sys.argv[0])
+        return 2
+
+    with open(sys.argv[1], "rb") as f:
+        contents = f.read()
+
+    try:
+        text = decode(contents)
+    except ValueError as e:
+        print("%s: %s" % (sys.argv[1], e), file=sys.stderr)
+        return 1
+
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "wb") as f:
+            f.write(text)
+    else:
+        sys.stdout.buffer.write(text)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())